@@ -0,0 +1,374 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+/*
+  Timings and allocation counts for the figures quoted in the docs.
+  Build with "make bench". Build the library with ARENA=YES to get the
+  arena figures too. Every test is run several times and the best time
+  is printed.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+#include "ucontainer.h"
+#include "ucio.h"
+#include "buffer.h"
+#include "ucpath.h"
+#include "ucview.h"
+#include "buffer_compress.h"
+#ifdef UC_ARENA
+#include "ucarena.h"
+#endif
+
+using namespace std;
+using namespace JAD;
+
+//every allocation is counted, in calls and in bytes
+static size_t allocations = 0;
+static size_t allocated = 0;
+
+//the replacements must not be inlined, or the compiler sees free called
+//on memory from operator new and warns of a mismatched pair
+#ifdef __GNUC__
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void* operator new(size_t n)
+{
+  allocations++;
+  allocated += n;
+  void* p = malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+BENCH_NOINLINE void operator delete(void* p) throw()
+{
+  free(p);
+}
+
+BENCH_NOINLINE void operator delete(void* p, size_t) throw()
+{
+  free(p);
+}
+
+static double now(void)
+{
+  struct timeval t;
+  gettimeofday(&t,NULL);
+  return t.tv_sec + t.tv_usec / 1e6;
+}
+
+static const int RUNS = 5;
+
+//best is the shortest time seen since start, over the runs so far
+static void keep_best(double& best, double start)
+{
+  double t = now() - start;
+  if (t < best) best = t;
+}
+
+static string record_json(void)
+{
+  return "{\"name\":\"John Smith\",\"age\":35,\"email\":\"john@test.com\","
+    "\"dependants\":[{\"name\":\"Jr Smith\",\"age\":10},{\"name\":\"Sue Smith\","
+    "\"age\":7},{\"name\":\"Sally Smith\",\"age\":17}],\"sex\":\"M\",\"manager\":false}";
+}
+
+static string records_json(int n)
+{
+  string rec = record_json();
+  string doc = "[";
+  for (int i = 0; i < n; i++) {
+    if (i) doc += ",";
+    doc += rec;
+  }
+  return doc + "]";
+}
+
+static UniversalContainer records(int n)
+{
+  UniversalContainer doc;
+  doc.init_map();
+  doc["meta"]["version"] = 3;
+  for (int i = 0; i < n; i++) {
+    UniversalContainer& r = doc["records"].added_element();
+    r["id"] = i;
+    r["name"] = "customer name";
+    r["total"] = i * 0.25;
+    r["address"]["street"] = "1 long street";
+    r["address"]["zip"] = i % 99999;
+    r["items"].added_element() = i;
+    r["items"].added_element() = "sku";
+  }
+  return doc;
+}
+
+//allocations made decoding, copying and building documents
+static void bench_allocations(void)
+{
+  string doc = records_json(1000);
+  Buffer buf((void*) doc.data(),doc.size());
+  size_t start = allocations;
+  UniversalContainer uc = uc_decode_json(&buf);
+  printf("allocations: decode 1000 records %lu",(unsigned long) (allocations - start));
+
+  start = allocations;
+  for (int i = 0; i < 1000; i++) {
+    UniversalContainer r = uc[i];
+    UniversalContainer d = r["dependants"];
+  }
+  printf(", 2000 copies %lu",(unsigned long) (allocations - start));
+
+  start = allocations;
+  UniversalContainer built;
+  built.init_array();
+  for (int i = 0; i < 1000; i++) {
+    UniversalContainer& r = built[i];
+    r["name"] = "John Smith";
+    r["email"] = "john.smith@example.com";
+    r["age"] = 35;
+    r["tags"].init_array();
+  }
+  printf(", build 1000 records %lu\n",(unsigned long) (allocations - start));
+}
+
+//decoding and freeing a large document, with and without an arena
+static void bench_arena(void)
+{
+  string doc = records_json(50000);
+  double decode = 1e9, teardown = 1e9;
+  for (int r = 0; r < RUNS; r++) {
+    Buffer buf((void*) doc.data(),doc.size());
+    double t0 = now();
+    UniversalContainer* uc = new UniversalContainer(uc_decode_json(&buf));
+    double t1 = now();
+    delete uc;
+    double t2 = now();
+    if (t1 - t0 < decode) decode = t1 - t0;
+    if (t2 - t1 < teardown) teardown = t2 - t1;
+  }
+  printf("arena: %.1f MB heap decode %.1f ms free %.1f ms",
+	 doc.size() / 1e6,decode * 1e3,teardown * 1e3);
+#ifdef UC_ARENA
+  decode = teardown = 1e9;
+  for (int r = 0; r < RUNS; r++) {
+    Buffer buf((void*) doc.data(),doc.size());
+    double t0 = now(), t1;
+    {
+      UCArena arena;
+      {
+	UCArenaScope scope(arena);
+	UniversalContainer* uc = new UniversalContainer(uc_decode_json(&buf));
+	t1 = now();
+	delete uc;
+      }
+    }
+    double t2 = now();
+    if (t1 - t0 < decode) decode = t1 - t0;
+    if (t2 - t1 < teardown) teardown = t2 - t1;
+  }
+  printf(", arena decode %.1f ms free %.1f ms",decode * 1e3,teardown * 1e3);
+#endif
+  printf("\n");
+}
+
+//the size of a container, and the memory and scan time of big arrays
+static void bench_compact(void)
+{
+  const int N = 1000000;
+  printf("compact: sizeof(UniversalContainer) %lu",
+	 (unsigned long) sizeof(UniversalContainer));
+  size_t start = allocated;
+  UniversalContainer nums;
+  nums.init_array();
+  nums.get_vector()->reserve(N);
+  for (int i = 0; i < N; i++) nums.added_element() = i;
+  size_t ints = allocated - start;
+
+  start = allocated;
+  UniversalContainer strs;
+  strs.init_array();
+  strs.get_vector()->reserve(N);
+  char tmp[16];
+  for (int i = 0; i < N; i++) {
+    snprintf(tmp,sizeof(tmp),"id-%07d",i);
+    strs.added_element() = tmp;
+  }
+  size_t strings = allocated - start;
+  printf(", bytes per element: ints %.1f, 10 character strings %.1f",
+	 (double) ints / N,(double) strings / N);
+
+  double best = 1e9;
+  long sum = 0;
+  for (int r = 0; r < RUNS; r++) {
+    double t0 = now();
+    UniversalArray::iterator end = nums.vector_end();
+    for (UniversalArray::iterator i = nums.vector_begin(); i != end; i++) sum += (long) *i;
+    keep_best(best,t0);
+  }
+  printf(", sum 1M ints %.2f ms (%ld)\n",best * 1e3,sum);
+}
+
+//is_dirty and clean on a big document after one deep write
+static void bench_dirty(void)
+{
+  UniversalContainer doc = records(100000);
+  doc.clean();
+  double check = 1e9;
+  double clean = 1e9;
+  bool dirty = false;
+  for (int r = 0; r < RUNS; r++) {
+    doc["records"][r * 1000]["address"]["zip"] = r;
+    double start = now();
+    for (int i = 0; i < 1000; i++) dirty = doc.is_dirty() || dirty;
+    keep_best(check,start);
+    start = now();
+    doc.clean();
+    keep_best(clean,start);
+  }
+  printf("dirty: 100000 records, is_dirty %.3f us, clean after one write %.3f ms (%d)\n",
+	 check * 1e3,clean * 1e3,(int) dirty);
+}
+
+static void bench_json_engines(const char* name, const string& doc)
+{
+  double lexer = 1e9, indexed = 1e9;
+  for (int r = 0; r < RUNS; r++) {
+    Buffer a((void*) doc.data(),doc.size());
+    double t0 = now();
+    uc_decode_json(&a,uc_JSON_Lexer);
+    keep_best(lexer,t0);
+    Buffer b((void*) doc.data(),doc.size());
+    t0 = now();
+    uc_decode_json(&b,uc_JSON_Indexed);
+    keep_best(indexed,t0);
+  }
+  double mb = doc.size() / 1e6;
+  printf("json %-8s %5.1f MB: lexer %6.1f MB/s, indexed %6.1f MB/s\n",
+	 name,mb,mb / lexer,mb / indexed);
+}
+
+//the lexer and the indexed decoder on records, long strings and numbers
+static void bench_json(void)
+{
+  bench_json_engines("records",records_json(50000));
+  string text = "[";
+  char tmp[32];
+  for (int i = 0; i < 20000; i++) {
+    snprintf(tmp,sizeof(tmp),"%s{\"id\":%d,",i ? "," : "",i);
+    text += tmp;
+    text += "\"body\":\"" + string(400,'x') + " lorem ipsum dolor sit amet\"}";
+  }
+  bench_json_engines("text",text + "]");
+  string nums = "[";
+  for (int i = 0; i < 500000; i++) {
+    snprintf(tmp,sizeof(tmp),"%s%d%s",i ? "," : "",i * 37 % 100003,i % 3 ? "" : ".5");
+    nums += tmp;
+  }
+  bench_json_engines("numbers",nums + "]");
+}
+
+//size and decode time of the binary options, and partial reads
+static void bench_binary(void)
+{
+  UniversalContainer doc = records(100000);
+  UCPathSet path;
+  path.add("meta.version");
+  int options[] = {0,uc_Binary_Offsets,uc_Binary_Keys,uc_Binary_Lengths,
+		   uc_Binary_Offsets | uc_Binary_Keys | uc_Binary_Lengths};
+  for (size_t k = 0; k < sizeof(options) / sizeof(options[0]); k++) {
+    Buffer* b = uc_encode_binary(doc,options[k]);
+    double full = 1e9, part = 1e9, lazy = 1e9, view = 1e9;
+    long sum = 0;
+    for (int r = 0; r < RUNS; r++) {
+      b->rewind();
+      double t0 = now();
+      uc_decode_binary(b);
+      keep_best(full,t0);
+      b->rewind();
+      t0 = now();
+      uc_decode_binary(b,path);
+      keep_best(part,t0);
+      b->rewind();
+      t0 = now();
+      UniversalContainer l = uc_decode_binary_lazy(b);
+      sum += (int) l["records"][5000]["id"];
+      keep_best(lazy,t0);
+      b->rewind();
+      t0 = now();
+      UCView v(b);
+      sum += (int) v["records.5000.id"];
+      keep_best(view,t0);
+    }
+    printf("binary options %d: %.2f MB, decode %.1f ms, one path %.2f ms, "
+	   "lazy %.2f ms, view %.3f ms (%ld)\n",options[k],b->length / 1e6,
+	   full * 1e3,part * 1e3,lazy * 1e3,view * 1e3,sum);
+    delete b;
+  }
+}
+
+//ratio and speed of each codec on JSON and binary output, and the
+//time to decode straight from a frame
+static void bench_compression(void)
+{
+  UniversalContainer doc = records(100000);
+  Buffer* inputs[2];
+  inputs[0] = uc_encode_json(doc);
+  inputs[1] = uc_encode_binary(doc);
+  const char* names[] = {"json","binary"};
+  const char* codecs[] = {"","lz4","deflate","zstd"};
+  for (int k = 0; k < 2; k++) {
+    Buffer* in = inputs[k];
+    for (int c = uc_Codec_LZ4; c <= uc_Codec_Zstd; c++) {
+      if (!uc_codec_available(c)) continue;
+      double pack = 1e9, unpack = 1e9, decode = 1e9;
+      size_t size = 0;
+      for (int r = 0; r < RUNS; r++) {
+	in->rewind();
+	double t0 = now();
+	Buffer* z = uc_compress(in,c);
+	keep_best(pack,t0);
+	size = z->length;
+	z->rewind();
+	t0 = now();
+	delete uc_decompress(z);
+	keep_best(unpack,t0);
+	z->rewind();
+	t0 = now();
+	if (k) uc_decode_binary(z);
+	else uc_decode_json(z,uc_JSON_Lexer);
+	keep_best(decode,t0);
+	delete z;
+      }
+      printf("compress %-6s %-7s %5.1f%%, compress %6.1f MB/s, decompress %6.1f MB/s, "
+	     "decode %.1f ms\n",names[k],codecs[c],100.0 * size / in->length,
+	     in->length / pack / 1e6,in->length / unpack / 1e6,decode * 1e3);
+    }
+    delete in;
+  }
+}
+
+int main(void)
+{
+  bench_allocations();
+  bench_arena();
+  bench_compact();
+  bench_dirty();
+  bench_json();
+  bench_binary();
+  bench_compression();
+  return 0;
+}
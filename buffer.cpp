@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <string.h>
 #include "buffer.h"
 
@@ -65,12 +66,14 @@ namespace JAD {
   bool Buffer::ensure_space(size_t need)
   {
     size_t total_need = wpos + need;
+    if (total_need < wpos) return false; //more than memory holds
     if (total_need <= size) return true;
 
     if (!own_data) return false; //if we don't own this buffer, return false;
 
-    size_t nsize = size << 1;
-    while (nsize < total_need) nsize <<= 1;
+    size_t nsize = size ? size << 1 : 1;
+    while (nsize < total_need && nsize <= SIZE_MAX / 2) nsize <<= 1;
+    if (nsize < total_need) nsize = total_need;
     char* ndata = new char[nsize];
     if (!ndata) return false;
     memcpy((void *)ndata, (void *)data, size);
@@ -83,11 +86,11 @@ namespace JAD {
   //copies len bytes from str to the buffer, adjusting
   //the write pointer as needed. returns t/f to indicate
   //success or failure.
-  bool Buffer::put_data(const char* str, int len)
+  bool Buffer::put_data(const char* str, size_t len)
   {
     if (!ensure_space(len)) return false;
-    for(int i = 0; i < len; i++,wpos++) 
-      data[wpos] = str[i];
+    memcpy(data + wpos,str,len);
+    wpos += len;
     if (length < wpos) length = wpos;
     return true;
   }
@@ -39,7 +39,7 @@ namespace JAD {
     Buffer(void*,size_t);
     ~Buffer(void);
    
-    bool put_data(const char*, int);
+    bool put_data(const char*, size_t);
     char* fetch_data(size_t);
     bool ensure_space(size_t);
     size_t copy_out(char*, size_t);
@@ -0,0 +1,606 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+#include <cstring>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#ifdef UC_ZLIB
+#include <zlib.h>
+#endif
+#ifdef UC_ZSTD
+#include <zstd.h>
+#endif
+#include "ucontainer.h"
+#include "buffer.h"
+#include "buffer_compress.h"
+
+using namespace std;
+
+namespace JAD {
+
+  static const char frame_magic[3] = {(char) 0xFF,'U','Z'};
+  //the most a varint size takes
+  static const size_t MAX_VARINT = sizeof(size_t) * 8 / 7 + 1;
+
+  /*
+    The LZ4 block format. A block is a run of sequences, each a token
+    byte, literals, then a match: a two byte little endian offset back
+    into the output, and a length of at least 4. The token's high four
+    bits are the count of literals and its low four the match length
+    less 4; a nibble of 15 goes on in bytes that are added to it,
+    stopping at the first below 255. The last sequence is only
+    literals. A match may not start within 12 bytes of the end, and
+    the last 5 bytes are always literals.
+  */
+
+  static const int LZ4_HASH_BITS = 12;
+  static const size_t LZ4_MIN_MATCH = 4;
+  static const size_t LZ4_LAST_LITERALS = 5;
+  static const size_t LZ4_MATCH_LIMIT = 12;
+  static const size_t LZ4_MAX_OFFSET = 65535;
+
+  static size_t lz4_bound(size_t len)
+  {
+    return len + len / 255 + 16;
+  }
+
+  static uint32_t read32(const unsigned char* p)
+  {
+    uint32_t v;
+    memcpy(&v,p,sizeof(v));
+    return v;
+  }
+
+  static unsigned lz4_hash(uint32_t v)
+  {
+    return (v * 2654435761U) >> (32 - LZ4_HASH_BITS);
+  }
+
+  static unsigned char* lz4_length(unsigned char* out, size_t len)
+  {
+    for (; len >= 255; len -= 255) *out++ = 255;
+    *out++ = (unsigned char) len;
+    return out;
+  }
+
+  static unsigned char* lz4_literals(unsigned char* out, const unsigned char* lit,
+				     size_t len, unsigned char*& token)
+  {
+    token = out++;
+    *token = (unsigned char) ((len < 15 ? len : 15) << 4);
+    if (len >= 15) out = lz4_length(out,len - 15);
+    memcpy(out,lit,len);
+    return out + len;
+  }
+
+  //compresses len bytes, of at most 64k, to out, which has room for
+  //lz4_bound(len). Matches are found greedily through a table of the
+  //last place each hash of four bytes was seen, and the search steps
+  //faster the longer it goes without one. It steps at least accel
+  //bytes on each miss, as with LZ4's acceleration.
+  static size_t lz4_compress(const unsigned char* in, size_t len, unsigned char* out,
+			     size_t accel)
+  {
+    const unsigned char* ip = in;
+    const unsigned char* anchor = in;
+    const unsigned char* end = in + len;
+    unsigned char* op = out;
+    unsigned char* token;
+
+    if (len > LZ4_MATCH_LIMIT) {
+      const unsigned char* limit = end - LZ4_MATCH_LIMIT;
+      const unsigned char* match_end = end - LZ4_LAST_LITERALS;
+      uint32_t table[1 << LZ4_HASH_BITS];
+      memset(table,0,sizeof(table));
+
+      while (ip < limit) {
+	uint32_t seen = read32(ip);
+	unsigned h = lz4_hash(seen);
+	const unsigned char* ref = in + table[h];
+	table[h] = ip - in;
+	if (ref >= ip || (size_t) (ip - ref) > LZ4_MAX_OFFSET || read32(ref) != seen) {
+	  size_t step = accel + ((ip - anchor) >> 6);
+	  if (step >= (size_t) (limit - ip)) break;
+	  ip += step;
+	  continue;
+	}
+	while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+	  ip--;
+	  ref--;
+	}
+	const unsigned char* m = ip + LZ4_MIN_MATCH;
+	const unsigned char* r = ref + LZ4_MIN_MATCH;
+	while (m < match_end && *m == *r) {
+	  m++;
+	  r++;
+	}
+
+	op = lz4_literals(op,anchor,ip - anchor,token);
+	size_t offset = ip - ref;
+	*op++ = (unsigned char) offset;
+	*op++ = (unsigned char) (offset >> 8);
+	size_t mlen = m - ip - LZ4_MIN_MATCH;
+	if (mlen >= 15) {
+	  *token |= 15;
+	  op = lz4_length(op,mlen - 15);
+	}
+	else *token |= (unsigned char) mlen;
+	ip = anchor = m;
+      }
+    }
+    op = lz4_literals(op,anchor,end - anchor,token);
+    return op - out;
+  }
+
+  static bool lz4_read_length(const unsigned char*& ip, const unsigned char* end,
+			      size_t& len)
+  {
+    unsigned char b;
+    do {
+      if (ip >= end) return false;
+      b = *ip++;
+      len += b;
+    } while (b == 255);
+    return true;
+  }
+
+  //false unless the block fills exactly raw bytes of out, without
+  //reading or writing past either end
+  static bool lz4_decompress(const unsigned char* in, size_t len,
+			     unsigned char* out, size_t raw)
+  {
+    const unsigned char* ip = in;
+    const unsigned char* end = in + len;
+    unsigned char* op = out;
+    unsigned char* oend = out + raw;
+
+    for (;;) {
+      if (ip >= end) return false;
+      unsigned token = *ip++;
+      size_t lit = token >> 4;
+      if (lit == 15 && !lz4_read_length(ip,end,lit)) return false;
+      if (lit > (size_t) (end - ip) || lit > (size_t) (oend - op)) return false;
+      memcpy(op,ip,lit);
+      ip += lit;
+      op += lit;
+      if (ip == end) return op == oend;
+
+      if (end - ip < 2) return false;
+      size_t offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (!offset || offset > (size_t) (op - out)) return false;
+      size_t mlen = token & 15;
+      if (mlen == 15 && !lz4_read_length(ip,end,mlen)) return false;
+      mlen += LZ4_MIN_MATCH;
+      if (mlen > (size_t) (oend - op)) return false;
+      const unsigned char* ref = op - offset;
+      if (offset >= mlen) memcpy(op,ref,mlen);
+      else for (size_t i = 0; i < mlen; i++) op[i] = ref[i]; //overlapping runs
+      op += mlen;
+    }
+  }
+
+  bool uc_codec_available(int codec)
+  {
+    switch (codec) {
+    case uc_Codec_LZ4 :
+      return true;
+#ifdef UC_ZLIB
+    case uc_Codec_Deflate :
+      return true;
+#endif
+#ifdef UC_ZSTD
+    case uc_Codec_Zstd :
+      return true;
+#endif
+    default :
+      return false;
+    }
+  }
+
+  //room needed to compress len bytes
+  static size_t codec_bound(int codec, size_t len)
+  {
+    switch (codec) {
+#ifdef UC_ZLIB
+    case uc_Codec_Deflate :
+      return compressBound(len);
+#endif
+#ifdef UC_ZSTD
+    case uc_Codec_Zstd :
+      return ZSTD_compressBound(len);
+#endif
+    default :
+      return lz4_bound(len);
+    }
+  }
+
+  //compresses to out, with room for codec_bound(len), and returns
+  //the size written
+  static size_t codec_compress(int codec, int level, const char* in, size_t len, char* out)
+  {
+    switch (codec) {
+#ifdef UC_ZLIB
+    case uc_Codec_Deflate : {
+      uLongf packed = compressBound(len);
+      if (compress2((Bytef*) out,&packed,(const Bytef*) in,len,
+		    level ? level : Z_DEFAULT_COMPRESSION) != Z_OK)
+	throw ucexception(uce_Serialization_Error);
+      return packed;
+    }
+#endif
+#ifdef UC_ZSTD
+    case uc_Codec_Zstd : {
+      size_t packed = ZSTD_compress(out,ZSTD_compressBound(len),in,len,level);
+      if (ZSTD_isError(packed)) throw ucexception(uce_Serialization_Error);
+      return packed;
+    }
+#endif
+    default :
+      return lz4_compress((const unsigned char*) in,len,(unsigned char*) out,
+			  level > 1 ? level : 1);
+    }
+  }
+
+  static bool codec_decompress(int codec, const char* in, size_t len, char* out, size_t raw)
+  {
+    switch (codec) {
+    case uc_Codec_LZ4 :
+      return lz4_decompress((const unsigned char*) in,len,(unsigned char*) out,raw);
+#ifdef UC_ZLIB
+    case uc_Codec_Deflate : {
+      uLongf got = raw;
+      return uncompress((Bytef*) out,&got,(const Bytef*) in,len) == Z_OK && got == raw;
+    }
+#endif
+#ifdef UC_ZSTD
+    case uc_Codec_Zstd :
+      return ZSTD_decompress(out,raw,in,len) == raw;
+#endif
+    default :
+      return false;
+    }
+  }
+
+  static char* put_size(char* out, size_t v)
+  {
+    while (v >= 0x80) {
+      *out++ = (char) (v | 0x80);
+      v >>= 7;
+    }
+    *out++ = (char) v;
+    return out;
+  }
+
+  static bool read_size(const unsigned char*& p, const unsigned char* end, size_t& v)
+  {
+    v = 0;
+    for (unsigned shift = 0; p < end && shift < sizeof(v) * 8; shift += 7) {
+      v |= (size_t) (*p & 0x7F) << shift;
+      if (!(*p++ & 0x80)) return true;
+    }
+    return false;
+  }
+
+  //an output that appends to a buffer
+  class BufferOutput : public UCOutput {
+  public:
+    BufferOutput(Buffer* b) : buffer(b) {}
+    void write(const char* data, size_t len)
+    {
+      if (!buffer->put_data(data,len)) throw ucexception(uce_Serialization_Error);
+    }
+
+  private:
+    Buffer* buffer;
+  };
+
+  UCCompressor::UCCompressor(UCOutput& out, int c, int l) :
+    output(&out), own_output(NULL), codec(c), level(l)
+  {
+    start();
+  }
+
+  UCCompressor::UCCompressor(Buffer* out, int c, int l) :
+    output(NULL), own_output(new BufferOutput(out)), codec(c), level(l)
+  {
+    output = own_output;
+    try {
+      start();
+    }
+    catch (...) {
+      delete own_output;
+      throw;
+    }
+  }
+
+  UCCompressor::~UCCompressor(void)
+  {
+    delete own_output;
+  }
+
+  void UCCompressor::start(void)
+  {
+    if (!uc_codec_available(codec)) throw ucexception(uce_Serialization_Error);
+    char header[4];
+    memcpy(header,frame_magic,sizeof(frame_magic));
+    header[3] = (char) codec;
+    output->write(header,sizeof(header));
+    block.reserve(uc_Compress_Block);
+    packed.resize(2 * MAX_VARINT + codec_bound(codec,uc_Compress_Block));
+  }
+
+  //writes one block. The sizes go in front of the compressed bytes,
+  //which are compressed to just past the most room the sizes could
+  //take, and then moved down if the sizes take less.
+  void UCCompressor::put_block(const char* data, size_t len)
+  {
+    char* body = &packed[2 * MAX_VARINT];
+    size_t size = codec_compress(codec,level,data,len,body);
+    if (size >= len) {
+      char sizes[2 * MAX_VARINT];
+      char* p = put_size(put_size(sizes,len),len);
+      output->write(sizes,p - sizes);
+      output->write(data,len);
+      return;
+    }
+    char sizes[2 * MAX_VARINT];
+    size_t n = put_size(put_size(sizes,len),size) - sizes;
+    memcpy(body - n,sizes,n);
+    output->write(body - n,n + size);
+  }
+
+  //whole blocks are compressed straight from the data written, and
+  //only a partial block is held back
+  void UCCompressor::write(const char* data, size_t len)
+  {
+    if (!block.empty()) {
+      size_t take = uc_Compress_Block - block.size();
+      if (take > len) take = len;
+      block.insert(block.end(),data,data + take);
+      data += take;
+      len -= take;
+      if (block.size() < uc_Compress_Block) return;
+      put_block(&block[0],block.size());
+      block.clear();
+    }
+    for (; len >= uc_Compress_Block; data += uc_Compress_Block, len -= uc_Compress_Block)
+      put_block(data,uc_Compress_Block);
+    block.insert(block.end(),data,data + len);
+  }
+
+  void UCCompressor::finish(void)
+  {
+    if (!block.empty()) put_block(&block[0],block.size());
+    block.clear();
+    char end = 0;
+    output->write(&end,1);
+  }
+
+  Buffer* uc_compress(Buffer* in, int codec, int level)
+  {
+    Buffer* out = new Buffer;
+    try {
+      UCCompressor compressor(out,codec,level);
+      compressor.write(in->data + in->rpos,in->length - in->rpos);
+      compressor.finish();
+    }
+    catch (...) {
+      delete out;
+      throw;
+    }
+    return out;
+  }
+
+  bool uc_is_compressed(const Buffer* buffer)
+  {
+    return buffer->length - buffer->rpos >= sizeof(frame_magic) + 1 &&
+      !memcmp(buffer->data + buffer->rpos,frame_magic,sizeof(frame_magic));
+  }
+
+  //decompresses one block of raw bytes to out
+  static void unpack_block(int codec, const char* data, size_t raw, size_t size, char* out)
+  {
+    if (!raw || raw > uc_Compress_Block || size > codec_bound(codec,raw))
+      throw ucexception(uce_Deserialization_Error);
+    if (size == raw) memcpy(out,data,raw);
+    else if (!codec_decompress(codec,data,size,out,raw))
+      throw ucexception(uce_Deserialization_Error);
+  }
+
+  //decompresses one block onto the end of the buffer
+  static void unpack_block(Buffer* out, int codec, const char* data, size_t raw, size_t size)
+  {
+    if (raw > uc_Compress_Block || !out->ensure_space(raw))
+      throw ucexception(uce_Deserialization_Error);
+    unpack_block(codec,data,raw,size,out->data + out->wpos);
+    out->wpos += raw;
+    if (out->length < out->wpos) out->length = out->wpos;
+  }
+
+  //every block's sizes are read and checked before anything is
+  //decompressed, so the total is known, and a frame cut short is
+  //found, before a decoder sees any of it
+  UCFrameReader::UCFrameReader(Buffer* b) : in(b), at(0), held(0)
+  {
+    if (!uc_is_compressed(in)) throw ucexception(uce_Deserialization_Error);
+    const unsigned char* p = (unsigned char*) in->data + in->rpos + sizeof(frame_magic);
+    const unsigned char* end = (unsigned char*) in->data + in->length;
+    codec = *p++;
+    if (!uc_codec_available(codec)) throw ucexception(uce_Deserialization_Error);
+    next = (char*) p - in->data;
+
+    size_t raw, size;
+    for (pending = 0;;) {
+      if (!read_size(p,end,raw)) throw ucexception(uce_Deserialization_Error);
+      if (!raw) break;
+      if (raw > uc_Compress_Block || pending > SIZE_MAX - raw ||
+	  !read_size(p,end,size) || size > (size_t) (end - p) ||
+	  size > codec_bound(codec,raw))
+	throw ucexception(uce_Deserialization_Error);
+      p += size;
+      pending += raw;
+    }
+    left = pending;
+    frame_end = (char*) p - in->data;
+  }
+
+  //a block that fits in what is still wanted is decompressed straight
+  //to out. Only one that does not goes through the held block.
+  size_t UCFrameReader::read(char* out, size_t len)
+  {
+    const unsigned char* end = (unsigned char*) in->data + in->length;
+    size_t sent = 0;
+    while (sent < len) {
+      if (at < held) {
+	size_t n = held - at < len - sent ? held - at : len - sent;
+	memcpy(out + sent,&block[at],n);
+	at += n;
+	sent += n;
+	continue;
+      }
+      if (!pending) break;
+
+      const unsigned char* p = (unsigned char*) in->data + next;
+      size_t raw, size;
+      read_size(p,end,raw);
+      read_size(p,end,size);
+      bool whole = raw <= len - sent;
+      if (!whole && block.empty()) block.resize(uc_Compress_Block);
+      unpack_block(codec,(const char*) p,raw,size,whole ? out + sent : &block[0]);
+      next = (char*) p + size - in->data;
+      pending -= raw;
+      in->rpos = pending ? next : frame_end;
+      if (whole) sent += raw;
+      else {
+	at = 0;
+	held = raw;
+      }
+    }
+    left -= sent;
+    return sent;
+  }
+
+  void UCFrameReader::finish(void)
+  {
+    in->rpos = frame_end;
+  }
+
+  //the frame is decompressed into the buffer a block at a time,
+  //straight from the input
+  Buffer* uc_decompress(Buffer* in)
+  {
+    UCFrameReader frame(in);
+    Buffer* out = new Buffer;
+    try {
+      if (!out->ensure_space(frame.remaining())) throw ucexception(uce_Deserialization_Error);
+      out->wpos = out->length = frame.read(out->data,frame.remaining());
+    }
+    catch (...) {
+      delete out;
+      throw;
+    }
+    frame.finish();
+    return out;
+  }
+
+  bool uc_decompress(Buffer* in, vector<char>& out)
+  {
+    if (!uc_is_compressed(in)) return false;
+    UCFrameReader frame(in);
+    out.resize(frame.remaining());
+    if (!out.empty()) frame.read(&out[0],out.size());
+    frame.finish();
+    return true;
+  }
+
+  static bool read_bytes(int fd, char* to, size_t len)
+  {
+    while (len) {
+      ssize_t got = read(fd,to,len);
+      if (got < 0 && errno == EINTR) continue;
+      if (got <= 0) return false;
+      to += got;
+      len -= got;
+    }
+    return true;
+  }
+
+  static bool read_bytes(FILE* file, char* to, size_t len)
+  {
+    return fread(to,1,len,file) == len;
+  }
+
+  //a varint read a byte at a time, so nothing past it is consumed
+  template <typename T>
+  static size_t read_stream_size(T in)
+  {
+    size_t v = 0;
+    for (unsigned shift = 0; shift < sizeof(v) * 8; shift += 7) {
+      unsigned char b;
+      if (!read_bytes(in,(char*) &b,1)) break;
+      v |= (size_t) (b & 0x7F) << shift;
+      if (!(b & 0x80)) return v;
+    }
+    throw ucexception(uce_Deserialization_Error);
+  }
+
+  //the frame from a stream. Each block's compressed bytes are read
+  //into one scratch buffer and decompressed from there.
+  template <typename T>
+  static Buffer* decompress_stream(T in)
+  {
+    unsigned char header[sizeof(frame_magic) + 1];
+    if (!read_bytes(in,(char*) header,sizeof(header)) ||
+	memcmp(header,frame_magic,sizeof(frame_magic)))
+      throw ucexception(uce_Deserialization_Error);
+    int codec = header[sizeof(frame_magic)];
+    if (!uc_codec_available(codec)) throw ucexception(uce_Deserialization_Error);
+
+    vector<char> scratch(codec_bound(codec,uc_Compress_Block));
+    Buffer* out = new Buffer;
+    try {
+      for (;;) {
+	size_t raw = read_stream_size(in);
+	if (!raw) break;
+	size_t size = read_stream_size(in);
+	if (size > scratch.size() || !read_bytes(in,&scratch[0],size))
+	  throw ucexception(uce_Deserialization_Error);
+	unpack_block(out,codec,&scratch[0],raw,size);
+      }
+    }
+    catch (...) {
+      delete out;
+      throw;
+    }
+    return out;
+  }
+
+  Buffer* uc_decompress(int fd)
+  {
+    return decompress_stream(fd);
+  }
+
+  Buffer* uc_decompress(FILE* file)
+  {
+    return decompress_stream(file);
+  }
+
+  UCDecompressed::UCDecompressed(Buffer* b) : given(b), raw(NULL)
+  {
+    if (uc_is_compressed(b)) raw = uc_decompress(b);
+  }
+
+  UCDecompressed::~UCDecompressed(void)
+  {
+    delete raw;
+  }
+
+} //end namespace
@@ -0,0 +1,156 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+/*
+  Block compression for Buffers. The data is cut into blocks of
+  uc_Compress_Block bytes, and each block is compressed on its own, so
+  output can be compressed as it is made, without holding the whole of
+  it, and read a block at a time. The LZ4 codec is built in. Deflate needs zlib, and the library built with UC_ZLIB;
+  zstd needs libzstd, and UC_ZSTD.
+
+  A compressed frame is the byte 0xFF, "UZ", and the codec. Then come
+  the blocks, each its size before and after compression as varints,
+  then its bytes. A block that would not shrink is stored as it was,
+  with both sizes the same. A block of size 0 ends the frame.
+
+  The decoders see a frame at the read position and read it through a
+  UCFrameReader. uc_decode_binary and uc_decode_binary_borrowed, and
+  uc_decode_json with the lexer, decode from the blocks as they are
+  decompressed, and hold no more than a block or two, and the longest
+  string, at once. Nothing borrows from the blocks, since they do not
+  outlive the call. The lazy decoders decompress straight to their
+  tape. The indexed JSON decoder, and the partial decoders, need the
+  whole of the text at once, and decompress the frame into a buffer
+  first.
+*/
+
+#ifndef _BUFFER_COMPRESS_H_
+#define _BUFFER_COMPRESS_H_
+
+#include <cstdio>
+#include <vector>
+#include "ucio.h"
+
+namespace JAD {
+
+  struct Buffer;
+
+  const int uc_Codec_LZ4 = 1;     //fast, built in
+  const int uc_Codec_Deflate = 2; //zlib, with UC_ZLIB
+  const int uc_Codec_Zstd = 3;    //libzstd, with UC_ZSTD
+  const size_t uc_Compress_Block = 64 * 1024;
+
+  //false for a codec the library was built without
+  bool uc_codec_available(int codec);
+
+  //an output that compresses what is written to it, and hands the
+  //frame on a block at a time. A level of 0 is the codec's default.
+  //For LZ4 a level above 1 is an acceleration, as in LZ4's own fast
+  //mode: the match search steps at least that many bytes on a miss,
+  //giving up ratio for speed. An unavailable codec, or a failed
+  //write, throws uce_Serialization_Error.
+  class UCCompressor : public UCOutput {
+  public:
+    UCCompressor(UCOutput& out, int codec = uc_Codec_LZ4, int level = 0);
+    //appends the frame to the buffer
+    UCCompressor(Buffer* out, int codec = uc_Codec_LZ4, int level = 0);
+    ~UCCompressor(void);
+
+    void write(const char* data, size_t len);
+    //compresses whatever is held back and ends the frame. Nothing may
+    //be written after.
+    void finish(void);
+
+  private:
+    UCOutput* output;
+    UCOutput* own_output;
+    int codec;
+    int level;
+    std::vector<char> block; //input not yet compressed
+    std::vector<char> packed; //a compressed block and its sizes
+
+    void start(void);
+    void put_block(const char* data, size_t len);
+  };
+
+  //the bytes from the read position to the end, as a frame
+  Buffer* uc_compress(Buffer*, int codec = uc_Codec_LZ4, int level = 0);
+
+  //true if a frame starts at the read position
+  bool uc_is_compressed(const Buffer*);
+
+  //reads the frame at the read position a block at a time. A read
+  //that takes in a whole block has it decompressed straight to where
+  //it is wanted; otherwise the block is held, and handed out over
+  //later reads. The read position moves past each block as it is
+  //taken, and past the end of the frame with the last. The buffer may
+  //not change while this reads from it. A damaged frame, or one in a
+  //codec the library was built without, throws
+  //uce_Deserialization_Error.
+  class UCFrameReader {
+  public:
+    explicit UCFrameReader(Buffer* in);
+    //copies up to len bytes to out, and returns how many; 0 at the
+    //end of the frame
+    size_t read(char* out, size_t len);
+    //the decompressed bytes still to be read
+    size_t remaining(void) const { return left; }
+    //moves the read position past the end of the frame, whatever is
+    //left of it
+    void finish(void);
+
+  private:
+    Buffer* in;
+    int codec;
+    size_t next; //where the next block's sizes are
+    size_t frame_end;
+    size_t pending; //bytes in the blocks not yet taken
+    size_t left;
+    std::vector<char> block;
+    size_t at; //how much of the held block is read
+    size_t held;
+
+    UCFrameReader(const UCFrameReader&);
+    void operator=(const UCFrameReader&);
+  };
+
+  //the frame at the read position, decompressed, leaving the read
+  //position just past it. A damaged frame, or one in a codec the
+  //library was built without, throws uce_Deserialization_Error.
+  Buffer* uc_decompress(Buffer*);
+  //the same, into out, or false if there is no frame
+  bool uc_decompress(Buffer*, std::vector<char>& out);
+  //reads a frame, decompressing each block as it arrives. The result
+  //still holds the whole of the decompressed data.
+  Buffer* uc_decompress(int fd);
+  Buffer* uc_decompress(FILE*);
+
+  //the decompressed copy of a frame at the read position, if there is
+  //one, freed when this goes out of scope. Used by the decoders that
+  //need the whole of it.
+  class UCDecompressed {
+  public:
+    explicit UCDecompressed(Buffer* b);
+    ~UCDecompressed(void);
+    //the decompressed buffer, or the one given if it was not
+    //compressed
+    Buffer* buffer(void) const { return raw ? raw : given; }
+    bool compressed(void) const { return raw != NULL; }
+
+  private:
+    Buffer* given;
+    Buffer* raw;
+
+    UCDecompressed(const UCDecompressed&);
+    void operator=(const UCDecompressed&);
+  };
+
+} //end namespace
+
+#endif
@@ -13,6 +13,7 @@
  */
 
 #include <stdio.h>
+#include <errno.h>
 #include <iostream>
 #include "buffer.h"
 #include <unistd.h>
@@ -32,25 +33,27 @@ namespace JAD {
   bool write_from_buffer(Buffer* buffer, FILE* fout)
   {
     if (buffer->rpos >= buffer->length) return false;
-    size_t sent = fwrite(buffer->data+buffer->rpos,1,
-			 buffer->length-buffer->rpos,fout);
+    size_t want = buffer->length - buffer->rpos;
+    size_t sent = fwrite(buffer->data+buffer->rpos,1,want,fout);
     buffer->rpos += sent;
-    return (buffer->length-buffer->rpos == sent);
+    return sent == want;
   }
   
+  //write may take less than it is given, so keep going until it has
+  //all been sent, or write fails
   bool write_from_buffer(Buffer* buffer, int fout)
   {
-    int sent = 1;
-    int total = 0;
     if (buffer->rpos >= buffer->length) return false;
 
-    while (sent > 0) {
-      sent = write(fout,buffer->data+total+buffer->rpos,
-		   buffer->length-total-buffer->rpos);
-      total += sent;
+    while (buffer->rpos < buffer->length) {
+      ssize_t sent = write(fout,buffer->data+buffer->rpos,
+			   buffer->length-buffer->rpos);
+      if (sent < 0) {
+	if (errno == EINTR) continue;
+	return false;
+      }
+      buffer->rpos += sent;
     }
-    buffer->rpos += total;
-    if (sent == -1) return false;
     return true;
   }
   
@@ -89,7 +92,7 @@ namespace JAD {
     
     while (got > 0) {
       got = read(fin,tmp,2048);
-      buffer->put_data(tmp,got);
+      if (got > 0) buffer->put_data(tmp,got);
     }
     
     if (got == -1) {
@@ -0,0 +1,846 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <string>
+#include <stdint.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "ucontainer.h"
+#include "buffer.h"
+#include "ucio.h"
+#include "json_index.h"
+#include "ucpath.h"
+#include "buffer_compress.h"
+
+using namespace std;
+
+namespace JAD {
+
+  /*
+    Stage one. Each 64 byte block is reduced to bit masks, one bit per
+    byte, for backslashes, quotes, structural characters and
+    whitespace. Quotes preceded by an odd run of backslashes are
+    dropped, and a running xor over the remaining quotes marks which
+    bytes are inside strings. The state carried from one block to the
+    next lives in JSONStructuralScanner.
+   */
+  struct BlockMasks {
+    uint64_t backslash;
+    uint64_t quote;
+    uint64_t op;
+    uint64_t space;
+  };
+
+#if defined(__AVX2__)
+  static inline uint64_t match32(__m256i v, char c)
+  {
+    return (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v,_mm256_set1_epi8(c)));
+  }
+
+  static inline void classify(const char* p, BlockMasks& m)
+  {
+    m.backslash = m.quote = m.op = m.space = 0;
+    for (int i = 0; i < 64; i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+      m.backslash |= match32(v,'\\') << i;
+      m.quote |= match32(v,'"') << i;
+      m.op |= (match32(v,'{') | match32(v,'}') | match32(v,'[') |
+	       match32(v,']') | match32(v,':') | match32(v,',')) << i;
+      m.space |= (match32(v,' ') | match32(v,'\t') | match32(v,'\n') |
+		  match32(v,'\r')) << i;
+    }
+  }
+#elif defined(__SSE2__)
+  static inline uint64_t match16(__m128i v, char c)
+  {
+    return (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v,_mm_set1_epi8(c)));
+  }
+
+  static inline void classify(const char* p, BlockMasks& m)
+  {
+    m.backslash = m.quote = m.op = m.space = 0;
+    for (int i = 0; i < 64; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      m.backslash |= match16(v,'\\') << i;
+      m.quote |= match16(v,'"') << i;
+      m.op |= (match16(v,'{') | match16(v,'}') | match16(v,'[') |
+	       match16(v,']') | match16(v,':') | match16(v,',')) << i;
+      m.space |= (match16(v,' ') | match16(v,'\t') | match16(v,'\n') |
+		  match16(v,'\r')) << i;
+    }
+  }
+#else
+  static inline void classify(const char* p, BlockMasks& m)
+  {
+    m.backslash = m.quote = m.op = m.space = 0;
+    for (int i = 0; i < 64; i++) {
+      uint64_t bit = (uint64_t) 1 << i;
+      switch (p[i]) {
+      case '\\' : m.backslash |= bit; break;
+      case '"' : m.quote |= bit; break;
+      case '{' : case '}' : case '[' : case ']' : case ':' : case ',' :
+	m.op |= bit;
+	break;
+      case ' ' : case '\t' : case '\n' : case '\r' :
+	m.space |= bit;
+	break;
+      }
+    }
+  }
+#endif
+
+  /*
+    Used by the encoder. The length of the run of bytes at the start of
+    p that can go into a JSON string as they are. Quotes, backslashes,
+    slashes and control characters end the run.
+   */
+#if defined(__AVX2__)
+  size_t json_clean_run(const char* p, size_t len)
+  {
+    size_t i = 0;
+    const __m256i low = _mm256_set1_epi8(0x1F);
+    for (; i + 32 <= len; i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+      uint32_t stop = match32(v,'"') | match32(v,'\\') | match32(v,'/') |
+	(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(v,low),low));
+      if (stop) return i + __builtin_ctz(stop);
+    }
+    for (; i < len; i++)
+      if ((unsigned char) p[i] < 0x20 || p[i] == '"' || p[i] == '\\' || p[i] == '/')
+	break;
+    return i;
+  }
+#elif defined(__SSE2__)
+  size_t json_clean_run(const char* p, size_t len)
+  {
+    size_t i = 0;
+    const __m128i low = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= len; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      unsigned stop = match16(v,'"') | match16(v,'\\') | match16(v,'/') |
+	(unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v,low),low));
+      if (stop) return i + __builtin_ctz(stop);
+    }
+    for (; i < len; i++)
+      if ((unsigned char) p[i] < 0x20 || p[i] == '"' || p[i] == '\\' || p[i] == '/')
+	break;
+    return i;
+  }
+#else
+  size_t json_clean_run(const char* p, size_t len)
+  {
+    size_t i;
+    for (i = 0; i < len; i++)
+      if ((unsigned char) p[i] < 0x20 || p[i] == '"' || p[i] == '\\' || p[i] == '/')
+	break;
+    return i;
+  }
+#endif
+
+  //bit i of the result is the xor of bits 0..i of x
+  static inline uint64_t prefix_xor(uint64_t x)
+  {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+  }
+
+  //the bytes escaped by a backslash. pending carries an escape
+  //across the block boundary. backslashes are rare, so this is
+  //done a bit at a time, and only for blocks that have them.
+  static inline uint64_t escaped_bytes(uint64_t backslash, bool& pending)
+  {
+    if (!backslash && !pending) return 0;
+    uint64_t escaped = 0;
+    for (int i = 0; i < 64; i++) {
+      uint64_t bit = (uint64_t) 1 << i;
+      if (pending) {
+	escaped |= bit;
+	pending = false;
+      }
+      else if (backslash & bit) pending = true;
+    }
+    return escaped;
+  }
+
+  JSONStructuralScanner::JSONStructuralScanner(void) :
+    pending(false), in_string(0), prev_scalar(0) {}
+
+  size_t JSONStructuralScanner::scan(const char* input, size_t length,
+				     size_t base, bool last,
+				     vector<unsigned>& index)
+  {
+    char tail[64];
+    size_t done;
+
+    for (done = 0; done < length; done += 64) {
+      const char* p = input + done;
+      if (length - done < 64) { //pad the last block with spaces
+	if (!last) break;
+	memset(tail,' ',64);
+	memcpy(tail,p,length - done);
+	p = tail;
+      }
+
+      BlockMasks m;
+      classify(p,m);
+      uint64_t quotes = m.quote & ~escaped_bytes(m.backslash,pending);
+      //includes the opening quote of each string, not the closing one
+      uint64_t strings = prefix_xor(quotes) ^ in_string;
+      in_string = (uint64_t)((int64_t) strings >> 63);
+
+      uint64_t scalar = ~(m.op | m.space | quotes | strings);
+      uint64_t starts = scalar & ~((scalar << 1) | prev_scalar);
+      prev_scalar = scalar >> 63;
+      uint64_t bits = (m.op & ~strings) | quotes | starts;
+
+      size_t n = index.size();
+      index.resize(n + __builtin_popcountll(bits));
+      while (bits) {
+	index[n++] = base + done + __builtin_ctzll(bits);
+	bits &= bits - 1;
+      }
+    }
+    return done < length ? done : length;
+  }
+
+  bool JSONStructuralScanner::inside_string(void) const
+  {
+    return in_string != 0;
+  }
+
+  bool json_structural_index(const char* input, size_t length,
+			     vector<unsigned>& index)
+  {
+    JSONStructuralScanner scanner;
+    index.clear();
+    index.reserve(length / 8 + 8);
+    scanner.scan(input,length,0,true,index);
+    return !scanner.inside_string();
+  }
+
+  /*
+    Stage two. A recursive descent over the index. Values come out as
+    the flex decoder makes them: a one character string becomes a
+    character, numbers and literals go through the same conversions
+    as string_interpret, and strings with escapes are handed to
+    unescape_json_string.
+   */
+  static bool is_space(char c)
+  {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+  }
+
+  static bool literal(const char* p, size_t len, const char* word)
+  {
+    return len == strlen(word) && !memcmp(p,word,len);
+  }
+
+  static bool digits(const char* p, size_t len, size_t& i)
+  {
+    size_t first = i;
+    while (i < len && p[i] >= '0' && p[i] <= '9') i++;
+    return i > first;
+  }
+
+  //[+-]?digits(.digits)?([eE][+-]?digits)?
+  static void number(UniversalContainer& uc, const char* p, size_t len)
+  {
+    size_t i = 0;
+    bool real = false;
+    if (i < len && (p[i] == '-' || p[i] == '+')) i++;
+    if (!digits(p,len,i)) throw ucexception(uce_Deserialization_Error);
+    if (i < len && p[i] == '.') {
+      i++;
+      real = true;
+      if (!digits(p,len,i)) throw ucexception(uce_Deserialization_Error);
+    }
+    if (i < len && (p[i] == 'e' || p[i] == 'E')) {
+      i++;
+      real = true;
+      if (i < len && (p[i] == '-' || p[i] == '+')) i++;
+      if (!digits(p,len,i)) throw ucexception(uce_Deserialization_Error);
+    }
+    if (i != len) throw ucexception(uce_Deserialization_Error);
+
+    //up to 18 digits cannot overflow a 64 bit long
+    if (!real && len < 19 && sizeof(long) >= 8) {
+      bool negative = p[0] == '-';
+      long l = 0;
+      for (i = (p[0] == '-' || p[0] == '+'); i < len; i++)
+	l = l * 10 + (p[i] - '0');
+      uc = negative ? -l : l;
+      return;
+    }
+
+    string text(p,len);
+    char* end;
+    if (!real) {
+      errno = 0;
+      long l = strtol(text.c_str(),&end,10);
+      if (!errno) {
+	uc = l;
+	return;
+      }
+    }
+    uc = strtod(text.c_str(),&end);
+  }
+
+  void json_scalar_value(UniversalContainer& uc, const char* p, size_t len)
+  {
+    while (len && is_space(p[len - 1])) len--;
+    if (literal(p,len,"true") || literal(p,len,"TRUE")) uc = true;
+    else if (literal(p,len,"false") || literal(p,len,"FALSE")) uc = false;
+    else if (literal(p,len,"null") || literal(p,len,"NULL")) uc.clear();
+    else number(uc,p,len);
+  }
+
+  void json_string_value(UniversalContainer& uc, char* p, size_t len, bool borrow)
+  {
+    if (memchr(p,'\\',len))
+      uc = unescape_json_string(p - 1);
+    else if (len == 1) uc = p[0];
+    else if (borrow) {
+      p[len] = '\0';
+      uc.borrow_string(p,len);
+    }
+    else uc = string(p,len);
+  }
+
+  void json_error_position(UniversalContainer& uce, size_t offset,
+			   size_t line, size_t column)
+  {
+    uce["input offset"] = (long) offset;
+    uce["input line"] = (long) line;
+    uce["input column"] = (long) column;
+  }
+
+  void json_error_position(UniversalContainer& uce, const char* input,
+			   size_t offset)
+  {
+    size_t line = 1;
+    const char* line_start = input;
+    const char* end = input + offset;
+    const char* nl;
+    while ((nl = static_cast<const char*>(memchr(line_start,'\n',end - line_start)))) {
+      line++;
+      line_start = nl + 1;
+    }
+    json_error_position(uce,offset,line,end - line_start + 1);
+  }
+
+  /*
+    The tape behind a lazily decoded document: a copy of its text, the
+    structural index, and for each opening bracket the entry of its
+    matching close, so a collection can be stepped over without looking
+    inside. Every collection not yet filled holds a reference.
+   */
+  struct JSONTape {
+    unsigned refcount;
+    vector<char> text;
+    vector<unsigned> index;
+    vector<unsigned> close;
+
+    JSONTape(void) : refcount(1) {}
+  };
+
+  //collections sharing a tape may be filled on different threads
+  static void tape_acquire(JSONTape* tape)
+  {
+#ifdef UC_THREADSAFE
+    __atomic_fetch_add(&tape->refcount,1,__ATOMIC_RELAXED);
+#else
+    tape->refcount++;
+#endif
+  }
+
+  static void tape_release(JSONTape* tape)
+  {
+#ifdef UC_THREADSAFE
+    if (__atomic_sub_fetch(&tape->refcount,1,__ATOMIC_ACQ_REL) == 0)
+      delete tape;
+#else
+    if (--tape->refcount == 0) delete tape;
+#endif
+  }
+
+  //pairs the brackets of the value starting at the first entry.
+  //Returns the entry the value ends on, or -1 if the brackets do not
+  //balance.
+  static long match_brackets(const char* input, const vector<unsigned>& index,
+			     vector<unsigned>& close)
+  {
+    vector<unsigned> open;
+    close.assign(index.size(),0);
+    for (size_t i = 0; i < index.size(); i++) {
+      char c = input[index[i]];
+      if (c == '{' || c == '[') open.push_back(i);
+      else if (c == '}' || c == ']') {
+	if (open.empty() || input[index[open.back()]] != (c == '}' ? '{' : '['))
+	  return -1;
+	close[open.back()] = i;
+	open.pop_back();
+      }
+      else if (c == '"') i++; //the closing quote
+      if (open.empty()) return i < index.size() ? (long) i : -1;
+    }
+    return -1;
+  }
+
+  class JSONIndexDecoder {
+  public:
+    //a borrowing decoder ends each string in place, writing a nul
+    //over its closing quote, and leaves the containers pointing into
+    //the input
+    JSONIndexDecoder(char* in, size_t len, bool b) :
+      input(in), length(len), borrow(b), tape(NULL), index(own_index),
+      close(own_close), next(0) {}
+
+    //decodes from a tape, deferring every map and array found
+    JSONIndexDecoder(JSONTape* t) :
+      input(&t->text[0]), length(t->text.size()), borrow(false), tape(t),
+      index(t->index), close(t->close), next(0) {}
+
+    size_t decode(UniversalContainer& uc)
+    {
+      if (!tape) build_index();
+      try {
+	value(uc);
+      }
+      catch (UniversalContainer& uce) {
+	json_error_position(uce,input,next < index.size() ? index[next] : length);
+	throw;
+      }
+      return next < index.size() ? index[next] : length;
+    }
+
+    //cuts a value already decoded down to the parts named by node of
+    //paths, as project does
+    static void project_decoded(UniversalContainer& uc, UniversalContainer& from,
+				const UCPathSet& paths, size_t node);
+
+    //decodes only the parts of the value named by paths
+    size_t decode(UniversalContainer& uc, const UCPathSet& paths)
+    {
+      build_index();
+      if (match_brackets(input,index,close) < 0) {
+	UniversalContainer uce = ucexception(uce_Deserialization_Error);
+	json_error_position(uce,input,index.back());
+	throw uce;
+      }
+      try {
+	project(uc,paths,0);
+      }
+      catch (UniversalContainer& uce) {
+	json_error_position(uce,input,next < index.size() ? index[next] : length);
+	throw;
+      }
+      return next < index.size() ? index[next] : length;
+    }
+
+    //fills in the deferred collection opened at entry
+    void fill(UniversalContainer& uc, size_t entry)
+    {
+      next = entry + 1;
+      try {
+	if (input[index[entry]] == '{') members(uc);
+	else elements(uc);
+      }
+      catch (UniversalContainer& uce) {
+	json_error_position(uce,input,next < index.size() ? index[next] : length);
+	throw;
+      }
+    }
+
+  private:
+    char* input;
+    size_t length;
+    bool borrow;
+    JSONTape* tape;
+    vector<unsigned> own_index;
+    vector<unsigned>& index;
+    vector<unsigned> own_close;
+    vector<unsigned>& close;
+    size_t next;
+
+    void build_index(void)
+    {
+      if (!json_structural_index(input,length,index) || index.empty()) {
+	//the input ends inside the string opened by the last entry
+	UniversalContainer uce = ucexception(uce_Deserialization_Error);
+	json_error_position(uce,input,index.empty() ? length : index.back());
+	throw uce;
+      }
+    }
+
+    char peek(void) const
+    {
+      if (next >= index.size()) throw ucexception(uce_Deserialization_Error);
+      return input[index[next]];
+    }
+
+    void expect(char c)
+    {
+      if (peek() != c) throw ucexception(uce_Deserialization_Error);
+      next++;
+    }
+
+    //the characters of the string opening at the next index entry.
+    //its closing quote is always the entry after.
+    void string_span(size_t& start, size_t& len)
+    {
+      expect('"');
+      if (next >= index.size()) throw ucexception(uce_Deserialization_Error);
+      start = index[next - 1] + 1;
+      len = index[next] - start;
+      next++;
+    }
+
+    void defer(UniversalContainer& uc, UniversalContainerType type);
+
+    void value(UniversalContainer& uc)
+    {
+      size_t start, len;
+
+      switch (peek()) {
+      case '{' :
+	if (tape) {
+	  defer(uc,uc_Map);
+	  return;
+	}
+	next++;
+	uc.init_map();
+	members(uc);
+	return;
+      case '[' :
+	if (tape) {
+	  defer(uc,uc_Array);
+	  return;
+	}
+	next++;
+	uc.init_array();
+	elements(uc);
+	return;
+      case '"' :
+	string_span(start,len);
+	json_string_value(uc,input + start,len,borrow);
+	return;
+      case '}' :
+      case ']' :
+      case ':' :
+      case ',' :
+	throw ucexception(uce_Deserialization_Error);
+      default :
+	scalar(uc);
+      }
+    }
+
+    //the members of a map, from just past its opening brace. Like
+    //the lexer, commas between members are optional and a trailing
+    //one is allowed.
+    void members(UniversalContainer& uc)
+    {
+      size_t start, len;
+
+      for (;;) {
+	if (peek() == '}') {
+	  next++;
+	  return;
+	}
+	string_span(start,len);
+	string key;
+	if (memchr(input + start,'\\',len))
+	  key = static_cast<string>(unescape_json_string(input + start - 1));
+	else key.assign(input + start,len);
+	expect(':');
+	//a dotted key names a path, as with the brackets operator
+	UniversalContainer& slot = key.find('.') == string::npos ?
+	  uc.map_element(key) : uc[key];
+	slot.clear(); //a repeated key replaces the earlier value
+	value(slot);
+	if (peek() == ',') next++;
+      }
+    }
+
+    //the elements of an array, from just past its opening bracket
+    void elements(UniversalContainer& uc)
+    {
+      if (peek() == ']') {
+	next++;
+	return;
+      }
+      for (;;) {
+	value(uc.added_element());
+	if (peek() == ',') next++;
+	else {
+	  expect(']');
+	  return;
+	}
+      }
+    }
+
+    //steps over the next value without making anything of it
+    void skip(void)
+    {
+      switch (peek()) {
+      case '{' :
+      case '[' :
+	next = close[next] + 1;
+	return;
+      case '"' :
+	next += 2;
+	return;
+      case '}' :
+      case ']' :
+      case ':' :
+      case ',' :
+	throw ucexception(uce_Deserialization_Error);
+      default :
+	next++;
+      }
+    }
+
+    //the part of the value wanted by node of paths. Collections off
+    //the paths are stepped over using the bracket pairs, so nothing
+    //in them is converted or unescaped. A scalar where the path goes
+    //on is not wanted: a map leaves its key out, and an array keeps a
+    //null so the indexes still line up.
+    void project(UniversalContainer& uc, const UCPathSet& paths, size_t node)
+    {
+      size_t start, len;
+
+      if (paths.whole(node)) {
+	value(uc);
+	return;
+      }
+      char c = peek();
+      if (c == '{') {
+	next++;
+	uc.init_map();
+	for (;;) {
+	  if (peek() == '}') {
+	    next++;
+	    return;
+	  }
+	  string_span(start,len);
+	  string key;
+	  if (memchr(input + start,'\\',len))
+	    key = static_cast<string>(unescape_json_string(input + start - 1));
+	  else key.assign(input + start,len);
+	  expect(':');
+	  size_t child = paths.step(node,key);
+	  c = peek();
+	  if (child && (paths.whole(child) || c == '{' || c == '[')) {
+	    UniversalContainer& slot = key.find('.') == string::npos ?
+	      uc.map_element(key) : uc[key];
+	    slot.clear();
+	    project(slot,paths,child);
+	  }
+	  else skip();
+	  if (peek() == ',') next++;
+	}
+      }
+      else if (c == '[') {
+	size_t open = next++;
+	uc.init_array();
+	long last = paths.last_index(node);
+	if (peek() == ']') {
+	  next++;
+	  return;
+	}
+	for (long i = 0;; i++) {
+	  if (i > last) {
+	    next = close[open];
+	    break;
+	  }
+	  size_t child = paths.step(node,(int) i);
+	  UniversalContainer& slot = uc.added_element();
+	  c = peek();
+	  if (child && (paths.whole(child) || c == '{' || c == '['))
+	    project(slot,paths,child);
+	  else skip();
+	  if (peek() == ',') next++;
+	  else break;
+	}
+	expect(']');
+      }
+      else skip();
+    }
+
+    //a number or literal, running up to the next entry in the index
+    void scalar(UniversalContainer& uc)
+    {
+      size_t start = index[next++];
+      size_t end = next < index.size() ? index[next] : length;
+      json_scalar_value(uc,input + start,end - start);
+    }
+  };
+
+  //fills a collection from the tape when it is first looked at
+  class JSONDeferred : public UCDeferred {
+  public:
+    JSONDeferred(JSONTape* t, size_t e) : tape(t), entry(e)
+    {
+      tape_acquire(tape);
+    }
+    ~JSONDeferred(void) { tape_release(tape); }
+
+    void fill(UniversalContainer& uc)
+    {
+      JSONIndexDecoder(tape).fill(uc,entry);
+    }
+
+  private:
+    JSONTape* tape;
+    size_t entry;
+  };
+
+  //leaves the collection empty, and steps over it
+  void JSONIndexDecoder::defer(UniversalContainer& uc, UniversalContainerType type)
+  {
+    uc.init_deferred(type,new JSONDeferred(tape,next));
+    next = tape->close[next] + 1;
+  }
+
+  //decodes one value from the buffer's read position, and leaves the
+  //read position at whatever follows it
+  UniversalContainer uc_decode_json_indexed(Buffer* buf, bool borrow)
+  {
+    UniversalContainer uc;
+    if (buf->length - buf->rpos > uc_JSON_Index_Limit)
+      throw ucexception(uce_Deserialization_Error);
+    JSONIndexDecoder decoder(buf->data + buf->rpos,buf->length - buf->rpos,borrow);
+    buf->rpos += decoder.decode(uc);
+    return uc;
+  }
+
+  //a compressed document is decompressed to a copy that goes away on
+  //return, so nothing may borrow from it
+  UniversalContainer uc_decode_json_borrowed(Buffer* buf)
+  {
+    UCDecompressed source(buf);
+    return uc_decode_json_indexed(source.buffer(),!source.compressed());
+  }
+
+  void JSONIndexDecoder::project_decoded(UniversalContainer& uc, UniversalContainer& from,
+					 const UCPathSet& paths, size_t node)
+  {
+    if (paths.whole(node)) {
+      uc = from;
+      return;
+    }
+    UniversalContainerType type = from.get_type();
+    if (type == uc_Map) {
+      uc.init_map();
+      std::vector<UniversalMapEntry> entries = from.map_entries();
+      for (size_t i = 0; i < entries.size(); i++) {
+	size_t child = paths.step(node,*entries[i].first);
+	UniversalContainerType t = entries[i].second->get_type();
+	if (child && (paths.whole(child) || t == uc_Map || t == uc_Array))
+	  project_decoded(uc.map_element(*entries[i].first),*entries[i].second,
+			  paths,child);
+      }
+    }
+    else if (type == uc_Array) {
+      uc.init_array();
+      long last = paths.last_index(node);
+      for (long i = 0; i <= last && i < (long) from.size(); i++) {
+	size_t child = paths.step(node,(int) i);
+	UniversalContainer& slot = uc.added_element();
+	UniversalContainer& element = from[(int) i];
+	UniversalContainerType t = element.get_type();
+	if (child && (paths.whole(child) || t == uc_Map || t == uc_Array))
+	  project_decoded(slot,element,paths,child);
+      }
+    }
+  }
+
+  UniversalContainer uc_decode_json(Buffer* buf, const UCPathSet& paths)
+  {
+    UCDecompressed source(buf);
+    UniversalContainer uc;
+    buf = source.buffer();
+    //past the index's reach the whole value is decoded by the lexer
+    //and cut down after
+    if (buf->length - buf->rpos > uc_JSON_Index_Limit) {
+      UniversalContainer whole = uc_decode_json(buf,uc_JSON_Lexer);
+      JSONIndexDecoder::project_decoded(uc,whole,paths,0);
+      return uc;
+    }
+    JSONIndexDecoder decoder(buf->data + buf->rpos,buf->length - buf->rpos,false);
+    buf->rpos += decoder.decode(uc,paths);
+    return uc;
+  }
+
+  /*
+    Only the index is built up front. The value's text is copied to a
+    tape, or a compressed document decompressed straight to it, and
+    each map or array is left empty until it is looked at, when its own
+    members are made and any collections inside them are deferred in
+    turn.
+   */
+  UniversalContainer uc_decode_json_lazy(Buffer* buf)
+  {
+    UniversalContainer uc;
+    bool packed = uc_is_compressed(buf);
+    const char* input = buf->data + buf->rpos;
+    size_t length = packed ? UCFrameReader(buf).remaining() : buf->length - buf->rpos;
+    //the tape's offsets cannot reach past the index limit, so larger
+    //documents are decoded whole by the lexer
+    if (length > uc_JSON_Index_Limit) return uc_decode_json(buf,uc_JSON_Lexer);
+
+    JSONTape* tape = new JSONTape;
+    try {
+      if (packed) {
+	uc_decompress(buf,tape->text);
+	if (length) input = &tape->text[0];
+      }
+      vector<unsigned>& index = tape->index;
+      if (!json_structural_index(input,length,index) || index.empty()) {
+	UniversalContainer uce = ucexception(uce_Deserialization_Error);
+	json_error_position(uce,input,index.empty() ? length : index.back());
+	throw uce;
+      }
+      long last = match_brackets(input,index,tape->close);
+      if (last < 0) {
+	UniversalContainer uce = ucexception(uce_Deserialization_Error);
+	json_error_position(uce,input,index.back());
+	throw uce;
+      }
+      //the value's text runs up to the entry after its last
+      size_t end = (size_t) last + 1;
+      size_t used = end < index.size() ? index[end] : length;
+      if (packed) tape->text.resize(used);
+      else tape->text.assign(input,input + used);
+      index.resize(end);
+      tape->close.resize(end);
+
+      JSONIndexDecoder decoder(tape);
+      decoder.decode(uc);
+      if (!packed) buf->rpos += used;
+    }
+    catch (...) {
+      tape_release(tape);
+      throw;
+    }
+    tape_release(tape);
+    return uc;
+  }
+
+} //end namespace
@@ -0,0 +1,89 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+/*
+  The indexed JSON decoder, an alternative to the flex lexer. It works
+  in two passes. The first scans the input 64 bytes at a time with
+  vector compares, and records the offset of every structural
+  character, every quote, and the first character of every number or
+  literal outside a string. The second walks that index and builds the
+  containers, so it never looks at the bytes in between.
+
+  The vector code is SSE2, or AVX2 when compiled with it enabled
+  (-mavx2, or -march=haswell and later), with a plain C++ fallback for
+  other processors. The input is not checked for valid UTF-8.
+*/
+
+#ifndef _JSON_INDEX_H_
+#define _JSON_INDEX_H_
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+namespace JAD {
+
+  class UniversalContainer;
+  struct Buffer;
+
+  //stage one, for input that arrives in pieces. scan appends the
+  //offsets found in input, plus base, to index. Unless last is set it
+  //only takes whole 64 byte blocks, and returns how many bytes it
+  //used, so the rest can be passed again with the next piece.
+  class JSONStructuralScanner {
+  public:
+    JSONStructuralScanner(void);
+    size_t scan(const char* input, size_t length, size_t base, bool last,
+		std::vector<unsigned>& index);
+    bool inside_string(void) const;
+
+  private:
+    bool pending;         //the next byte is escaped
+    uint64_t in_string;   //all ones while a string is open
+    uint64_t prev_scalar; //the last byte scanned was part of a scalar
+  };
+
+  //offsets of the structural characters in input. Returns false if
+  //the input ends inside a string.
+  bool json_structural_index(const char* input, size_t length,
+			     std::vector<unsigned>& index);
+
+  //stage two conversions. A number or literal, with any trailing
+  //whitespace, and the len characters of a string that starts at p,
+  //just after its opening quote.
+  void json_scalar_value(UniversalContainer&, const char* p, size_t len);
+  void json_string_value(UniversalContainer&, char* p, size_t len, bool borrow);
+
+  //offsets in the index are 32 bits, so it covers at most this many
+  //bytes of input
+  const size_t uc_JSON_Index_Limit = 0xFFFFFFFFUL;
+
+  //with borrow set, strings without escapes are left in the buffer,
+  //as for uc_decode_json_borrowed. Input longer than
+  //uc_JSON_Index_Limit throws uce_Deserialization_Error.
+  UniversalContainer uc_decode_json_indexed(Buffer*, bool borrow = false);
+
+  //for the encoder, the number of bytes at p, up to len, that need no
+  //escaping inside a JSON string
+  size_t json_clean_run(const char* p, size_t len);
+
+  //sets "input offset", "input line" and "input column" in a
+  //deserialization exception. Lines and columns count from 1. The
+  //second form works them out from the offset bytes before input + offset.
+  void json_error_position(UniversalContainer& uce, size_t offset,
+			   size_t line, size_t column);
+  void json_error_position(UniversalContainer& uce, const char* input,
+			   size_t offset);
+
+  //found in ucoder_json.cpp
+  UniversalContainer unescape_json_string(char*);
+
+} //end namespace
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+#include <cstring>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ucontainer.h"
+#include "buffer.h"
+#include "json_index.h"
+#include "json_lines.h"
+
+using namespace std;
+
+namespace JAD {
+
+  //chunks smaller than this are not worth handing to another thread
+  static const size_t MIN_CHUNK = 256 * 1024;
+  static const size_t NO_FAILURE = (size_t) -1;
+
+  /*
+    Work shared by the threads. Chunks are claimed in order, and at
+    most ahead of them may be decoded and waiting to be handed over,
+    so a slow handler does not let the whole input pile up in memory.
+    The calling thread decodes chunks too, while it waits.
+   */
+  struct JSONLinesJob {
+    const char* data;
+    vector<size_t> starts; //chunk i runs from starts[i] to starts[i+1]
+    vector<UniversalContainer> results;
+    vector<size_t> failed; //offset of the bad line in each chunk
+    vector<char> done;
+    vector<UniversalContainer> spent; //handed over, for a worker to free
+    size_t claimed;
+    size_t delivered;
+    size_t ahead;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    size_t chunks(void) const { return starts.size() - 1; }
+    bool claimable(void) const
+    {
+      return !stop && claimed < chunks() && claimed < delivered + ahead;
+    }
+  };
+
+  static bool blank(const char* p, const char* end)
+  {
+    for (; p < end; p++)
+      if (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') return false;
+    return true;
+  }
+
+  static void decode_chunk(JSONLinesJob* job, size_t i)
+  {
+    const char* p = job->data + job->starts[i];
+    const char* end = job->data + job->starts[i + 1];
+    UniversalContainer& out = job->results[i];
+
+    out.init_array();
+    while (p < end) {
+      const char* eol = static_cast<const char*>(memchr(p,'\n',end - p));
+      if (!eol) eol = end;
+      if (!blank(p,eol)) {
+	Buffer line(const_cast<char*>(p),eol - p);
+	try {
+	  out.added_element() = uc_decode_json_indexed(&line);
+	  if (!blank(line.data + line.rpos,eol))
+	    throw ucexception(uce_Deserialization_Error);
+	}
+	catch (...) {
+	  job->failed[i] = p - job->data;
+	  return;
+	}
+      }
+      p = eol + 1;
+    }
+  }
+
+  //claims and decodes chunks until there are none left that may be
+  //claimed. Called, and returns, with the lock held.
+  static void decode_claimable(JSONLinesJob* job)
+  {
+    while (job->claimable()) {
+      size_t i = job->claimed++;
+      pthread_mutex_unlock(&job->lock);
+      decode_chunk(job,i);
+      pthread_mutex_lock(&job->lock);
+      job->done[i] = true;
+      pthread_cond_broadcast(&job->changed);
+    }
+  }
+
+  //frees chunks the calling thread is done with. Called, and
+  //returns, with the lock held.
+  static void release_spent(JSONLinesJob* job)
+  {
+    while (!job->spent.empty()) {
+      UniversalContainer records = job->spent.back();
+      job->spent.pop_back();
+      pthread_mutex_unlock(&job->lock);
+      records.clear();
+      pthread_mutex_lock(&job->lock);
+    }
+  }
+
+  static void* json_lines_worker(void* arg)
+  {
+    JSONLinesJob* job = static_cast<JSONLinesJob*>(arg);
+    pthread_mutex_lock(&job->lock);
+    for (;;) {
+      release_spent(job);
+      decode_claimable(job);
+      if (job->stop) break;
+      pthread_cond_wait(&job->changed,&job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+  }
+
+  static void finish(JSONLinesJob& job, vector<pthread_t>& pool)
+  {
+    pthread_mutex_lock(&job.lock);
+    job.stop = true;
+    pthread_cond_broadcast(&job.changed);
+    pthread_mutex_unlock(&job.lock);
+    for (size_t i = 0; i < pool.size(); i++) pthread_join(pool[i],NULL);
+    pthread_cond_destroy(&job.changed);
+    pthread_mutex_destroy(&job.lock);
+  }
+
+  void uc_decode_json_lines(Buffer* buf, JSONLinesHandler& handler, int threads)
+  {
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+
+    JSONLinesJob job;
+    job.data = buf->data + buf->rpos;
+    size_t length = buf->length - buf->rpos;
+    buf->rpos = buf->length;
+
+    //about eight chunks a thread, cut just after a line break
+    size_t chunk = length / (threads * 8);
+    if (chunk < MIN_CHUNK) chunk = MIN_CHUNK;
+    for (size_t start = 0; start < length;) {
+      job.starts.push_back(start);
+      if (length - start <= chunk) break;
+      const char* nl = static_cast<const char*>(memchr(job.data + start + chunk,'\n',
+						       length - start - chunk));
+      start = nl ? nl - job.data + 1 : length;
+    }
+    job.starts.push_back(length);
+
+    job.results.resize(job.chunks());
+    job.failed.resize(job.chunks(),NO_FAILURE);
+    job.done.resize(job.chunks(),false);
+    job.claimed = job.delivered = 0;
+    job.ahead = threads * 2;
+    job.stop = false;
+    pthread_mutex_init(&job.lock,NULL);
+    pthread_cond_init(&job.changed,NULL);
+
+    vector<pthread_t> pool;
+    for (int i = 1; i < threads && (size_t) i < job.chunks(); i++) {
+      pthread_t t;
+      if (pthread_create(&t,NULL,json_lines_worker,&job)) break;
+      pool.push_back(t);
+    }
+
+    try {
+      for (size_t i = 0; i < job.chunks(); i++) {
+	pthread_mutex_lock(&job.lock);
+	while (!job.done[i]) {
+	  decode_claimable(&job);
+	  if (!job.done[i]) pthread_cond_wait(&job.changed,&job.lock);
+	}
+	pthread_mutex_unlock(&job.lock);
+
+	UniversalContainer records = job.results[i];
+	job.results[i].clear();
+	for (size_t r = 0; r < records.size(); r++)
+	  handler.record(records[(int) r]);
+
+	if (job.failed[i] != NO_FAILURE) {
+	  size_t line = 1;
+	  for (const char* p = job.data; p < job.data + job.failed[i]; p++)
+	    if (*p == '\n') line++;
+	  UniversalContainer uce = ucexception(uce_Deserialization_Error);
+	  uce["input line"] = (long) line;
+	  throw uce;
+	}
+
+	pthread_mutex_lock(&job.lock);
+#ifdef UC_THREADSAFE
+	//freeing a chunk is a good part of the work, and with atomic
+	//reference counts it can be left to a worker
+	if (!pool.empty()) job.spent.push_back(records);
+#endif
+	job.delivered++;
+	pthread_cond_broadcast(&job.changed);
+	pthread_mutex_unlock(&job.lock);
+      }
+    }
+    catch (...) {
+      finish(job,pool);
+      throw;
+    }
+    finish(job,pool);
+  }
+
+  class JSONLinesCollector : public JSONLinesHandler {
+  public:
+    UniversalContainer all;
+    JSONLinesCollector(void) { all.init_array(); }
+    void record(UniversalContainer& uc) { all.added_element() = uc; }
+  };
+
+  UniversalContainer uc_decode_json_lines(Buffer* buf, int threads)
+  {
+    JSONLinesCollector collector;
+    uc_decode_json_lines(buf,collector,threads);
+    return collector.all;
+  }
+
+  UniversalContainer uc_from_json_lines_file(const char* fname, int threads)
+  {
+    UniversalContainer uc;
+    int fd = open(fname,O_RDONLY);
+    if (fd < 0) return uc;
+
+    struct stat st;
+    if (fstat(fd,&st) || !st.st_size) {
+      close(fd);
+      uc.init_array();
+      return uc;
+    }
+    void* map = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (map == MAP_FAILED) return uc;
+
+    Buffer buf(map,st.st_size);
+    try {
+      uc = uc_decode_json_lines(&buf,threads);
+    }
+    catch (...) {
+      munmap(map,st.st_size);
+      throw;
+    }
+    munmap(map,st.st_size);
+    return uc;
+  }
+
+} //end namespace
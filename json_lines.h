@@ -0,0 +1,48 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+/*
+  JSON Lines (newline delimited JSON) decoding. The input is cut into
+  chunks at line breaks, and the chunks are decoded by a pool of POSIX
+  threads with the indexed decoder. Records still come out in input
+  order. Blank lines are skipped.
+*/
+
+#ifndef _JSON_LINES_H_
+#define _JSON_LINES_H_
+
+#include "ucontainer.h"
+
+namespace JAD {
+
+  struct Buffer;
+
+  //receives each record, in order, on the thread that called
+  //uc_decode_json_lines
+  class JSONLinesHandler {
+  public:
+    virtual ~JSONLinesHandler(void) {}
+    virtual void record(UniversalContainer&) = 0;
+  };
+
+  //decode every line from the buffer's read position on. threads of
+  //0 uses one thread per processor. A bad line throws
+  //uce_Deserialization_Error, with its "input line" set, once the
+  //records before it have been handed over.
+  void uc_decode_json_lines(Buffer*, JSONLinesHandler&, int threads = 0);
+
+  //all of the records, as an array
+  UniversalContainer uc_decode_json_lines(Buffer*, int threads = 0);
+
+  //maps the file into memory rather than reading it
+  UniversalContainer uc_from_json_lines_file(const char* fname, int threads = 0);
+
+} //end namespace
+
+#endif
@@ -0,0 +1,358 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+#include <cstring>
+#include <string>
+#include "ucontainer.h"
+#include "buffer.h"
+#include "json_index.h"
+#include "json_sax.h"
+
+using namespace std;
+
+namespace JAD {
+
+  //where the parser gets its input from
+  class JSONSource {
+  public:
+    virtual ~JSONSource(void) {}
+    //copy up to len bytes to dest, returning 0 at the end of input
+    virtual size_t read(char* dest, size_t len) = 0;
+    //hand back the last len bytes read, which were not used
+    virtual void unread(size_t) {}
+  };
+
+  class JSONBufferSource : public JSONSource {
+  public:
+    JSONBufferSource(Buffer* b) : buf(b) {}
+    size_t read(char* dest, size_t len) { return buf->copy_out(dest,len); }
+    void unread(size_t len) { buf->rpos -= len; }
+  private:
+    Buffer* buf;
+  };
+
+  class JSONFileSource : public JSONSource {
+  public:
+    JSONFileSource(FILE* f) : file(f) {}
+    size_t read(char* dest, size_t len)
+    {
+      size_t got = fread(dest,1,len,file);
+      if (!got && ferror(file)) throw ucexception(uce_Deserialization_Error);
+      return got;
+    }
+  private:
+    FILE* file;
+  };
+
+  /*
+    The input is held in a window. Each refill drops whatever has been
+    used from the front of the window, reads more in behind the rest,
+    and indexes the new bytes. A token is only used once the index
+    entry after it has been found, so a string or number is never
+    split across two reads. The window grows only when a single token
+    will not fit in it.
+   */
+  class JSONStreamParser {
+  public:
+    JSONStreamParser(JSONSource& s, JSONHandler& h) :
+      source(s), handler(h), window(64 * 1024), filled(0), indexed(0),
+      used(0), next(0), at_end(false) {}
+
+    void parse(void);
+
+  private:
+    JSONSource& source;
+    JSONHandler& handler;
+    vector<char> window;
+    size_t filled;  //bytes of window holding input
+    size_t indexed; //bytes of window the scanner has seen
+    size_t used;    //bytes of window up to the end of the last token
+    JSONStructuralScanner scanner;
+    vector<unsigned> index;
+    size_t next;    //the first entry of index not yet used
+    bool at_end;
+
+    //what the parser will accept next
+    enum State { Want_Value, Want_Key, Want_Colon, Want_Member,
+		 Want_Element, Want_Item };
+
+    bool refill(void);
+    bool ready(size_t entries);
+    char peek(void);
+    void value(char c, State& state, vector<char>& nesting);
+    string key(void);
+    size_t string_span(size_t& start);
+  };
+
+  bool JSONStreamParser::refill(void)
+  {
+    if (at_end) return false;
+
+    size_t keep = next < index.size() ? index[next] : indexed;
+    memmove(&window[0],&window[0] + keep,filled - keep);
+    filled -= keep;
+    indexed -= keep;
+    used = used > keep ? used - keep : 0;
+    for (size_t i = next; i < index.size(); i++)
+      index[i - next] = index[i] - keep;
+    index.resize(index.size() - next);
+    next = 0;
+
+    if (filled == window.size()) {
+      //offsets in the index are 32 bits
+      if (window.size() > 0x7FFFFFFFUL)
+	throw ucexception(uce_Deserialization_Error);
+      window.resize(window.size() * 2);
+    }
+    size_t got = source.read(&window[filled],window.size() - filled);
+    if (!got) at_end = true;
+    filled += got;
+    indexed += scanner.scan(&window[indexed],filled - indexed,indexed,
+			    at_end,index);
+    return true;
+  }
+
+  //true once the next entries entries of the index are known
+  bool JSONStreamParser::ready(size_t entries)
+  {
+    while (index.size() - next < entries)
+      if (!refill()) return false;
+    return true;
+  }
+
+  char JSONStreamParser::peek(void)
+  {
+    if (!ready(1)) throw ucexception(uce_Deserialization_Error);
+    return window[index[next]];
+  }
+
+  //the string opening at the next entry, which must be complete
+  size_t JSONStreamParser::string_span(size_t& start)
+  {
+    if (!ready(2)) throw ucexception(uce_Deserialization_Error);
+    start = index[next] + 1;
+    size_t len = index[next + 1] - start;
+    used = index[next + 1] + 1;
+    next += 2;
+    return len;
+  }
+
+  string JSONStreamParser::key(void)
+  {
+    size_t start;
+    size_t len = string_span(start);
+    if (memchr(&window[start],'\\',len))
+      return static_cast<string>(unescape_json_string(&window[start - 1]));
+    return string(&window[start],len);
+  }
+
+  //starts the value at the next entry. Collections are opened, and
+  //left to the main loop to fill.
+  void JSONStreamParser::value(char c, State& state, vector<char>& nesting)
+  {
+    UniversalContainer uc;
+    size_t start, len;
+
+    switch (c) {
+    case '{' :
+      used = index[next++] + 1;
+      nesting.push_back('{');
+      handler.start_map();
+      state = Want_Key;
+      return;
+    case '[' :
+      used = index[next++] + 1;
+      nesting.push_back('[');
+      handler.start_array();
+      state = Want_Element;
+      return;
+    case '"' :
+      len = string_span(start);
+      json_string_value(uc,&window[start],len,false);
+      break;
+    case '}' :
+    case ']' :
+    case ':' :
+    case ',' :
+      throw ucexception(uce_Deserialization_Error);
+    default :
+      //a scalar runs up to the next entry, or the end of input
+      if (ready(2)) len = index[next + 1];
+      else if (at_end) len = filled;
+      else throw ucexception(uce_Deserialization_Error);
+      start = index[next++];
+      used = len;
+      json_scalar_value(uc,&window[start],len - start);
+    }
+    handler.scalar(uc);
+    state = nesting.empty() ? Want_Value :
+      nesting.back() == '{' ? Want_Member : Want_Item;
+  }
+
+  /*
+    The grammar is followed with an explicit stack, so deep nesting
+    does not use up the call stack. As with the other JSON decoders,
+    commas between map members are optional and a trailing one is
+    allowed.
+   */
+  void JSONStreamParser::parse(void)
+  {
+    vector<char> nesting;
+    State state = Want_Value;
+    bool done = false;
+
+    while (!done) {
+      char c = peek();
+      switch (state) {
+      case Want_Value :
+	value(c,state,nesting);
+	break;
+      case Want_Member :
+	if (c == ',') {
+	  next++;
+	  state = Want_Key;
+	  break;
+	}
+	//the comma is optional
+	/*FALLTHROUGH*/
+      case Want_Key :
+	if (c == '"') {
+	  handler.key(key());
+	  state = Want_Colon;
+	}
+	else if (c == '}') {
+	  used = index[next++] + 1;
+	  nesting.pop_back();
+	  handler.end_map();
+	  state = Want_Item;
+	}
+	else throw ucexception(uce_Deserialization_Error);
+	break;
+      case Want_Colon :
+	if (c != ':') throw ucexception(uce_Deserialization_Error);
+	next++;
+	value(peek(),state,nesting);
+	break;
+      case Want_Element :
+	if (c == ']') {
+	  used = index[next++] + 1;
+	  nesting.pop_back();
+	  handler.end_array();
+	  state = Want_Item;
+	}
+	else value(c,state,nesting);
+	break;
+      case Want_Item :
+	if (c == ',' && !nesting.empty() && nesting.back() == '[') {
+	  next++;
+	  value(peek(),state,nesting);
+	}
+	else if (c == ']' && !nesting.empty() && nesting.back() == '[') {
+	  used = index[next++] + 1;
+	  nesting.pop_back();
+	  handler.end_array();
+	}
+	else throw ucexception(uce_Deserialization_Error);
+	break;
+      }
+
+      //a value just finished at the top level
+      if (nesting.empty() && (state == Want_Value || state == Want_Item))
+	done = true;
+      //a collection just finished inside a map
+      else if (state == Want_Item && nesting.back() == '{')
+	state = Want_Member;
+    }
+    source.unread(filled - used);
+  }
+
+  void uc_parse_json(Buffer* buf, JSONHandler& handler)
+  {
+    JSONBufferSource source(buf);
+    JSONStreamParser parser(source,handler);
+    parser.parse();
+  }
+
+  void uc_parse_json(FILE* file, JSONHandler& handler)
+  {
+    JSONFileSource source(file);
+    JSONStreamParser parser(source,handler);
+    parser.parse();
+  }
+
+  /*
+    JSONElementHandler
+   */
+  JSONElementHandler::JSONElementHandler(void) : in_array(false) {}
+
+  //where the next value goes
+  UniversalContainer& JSONElementHandler::slot(void)
+  {
+    if (open.empty()) return current;
+    UniversalContainer& parent = *open.back();
+    if (parent.get_type() == uc_Array) return parent.added_element();
+    UniversalContainer& member = parent[pending_key];
+    member.clear(); //a repeated key replaces the earlier value
+    return member;
+  }
+
+  void JSONElementHandler::start_map(void)
+  {
+    UniversalContainer& uc = slot();
+    uc.init_map();
+    open.push_back(&uc);
+  }
+
+  void JSONElementHandler::key(const string& k)
+  {
+    pending_key = k;
+  }
+
+  void JSONElementHandler::start_array(void)
+  {
+    if (open.empty() && !in_array) { //the top level array itself
+      in_array = true;
+      return;
+    }
+    UniversalContainer& uc = slot();
+    uc.init_array();
+    open.push_back(&uc);
+  }
+
+  void JSONElementHandler::end_map(void)
+  {
+    end_collection();
+  }
+
+  void JSONElementHandler::end_array(void)
+  {
+    end_collection();
+  }
+
+  void JSONElementHandler::end_collection(void)
+  {
+    if (open.empty()) { //the end of the top level array
+      in_array = false;
+      return;
+    }
+    open.pop_back();
+    if (!open.empty()) return;
+    element(current);
+    current.clear();
+  }
+
+  void JSONElementHandler::scalar(const UniversalContainer& uc)
+  {
+    slot() = uc;
+    if (!open.empty()) return;
+    element(current);
+    current.clear();
+  }
+
+} //end namespace
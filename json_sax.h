@@ -0,0 +1,79 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+/*
+  Event driven JSON parsing, for input too large to hold as a tree.
+  The parser reads its input a piece at a time, indexes each piece
+  with the same scanner as the indexed decoder, and reports what it
+  finds to a JSONHandler as it goes. Memory use depends on the size of
+  the largest single token, not the size of the input.
+*/
+
+#ifndef _JSON_SAX_H_
+#define _JSON_SAX_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "ucontainer.h"
+
+namespace JAD {
+
+  struct Buffer;
+
+  //override the events of interest. Numbers, strings and literals
+  //arrive through scalar, converted the same way uc_decode_json
+  //converts them. A key is always followed by its value.
+  class JSONHandler {
+  public:
+    virtual ~JSONHandler(void) {}
+    virtual void start_map(void) {}
+    virtual void key(const std::string&) {}
+    virtual void end_map(void) {}
+    virtual void start_array(void) {}
+    virtual void end_array(void) {}
+    virtual void scalar(const UniversalContainer&) {}
+  };
+
+  //builds each element of a top level array in turn and hands it to
+  //element, so only one element is held at a time. If the top level
+  //value is not an array, it is handed over whole.
+  class JSONElementHandler : public JSONHandler {
+  public:
+    JSONElementHandler(void);
+    void start_map(void);
+    void key(const std::string&);
+    void end_map(void);
+    void start_array(void);
+    void end_array(void);
+    void scalar(const UniversalContainer&);
+
+  protected:
+    virtual void element(UniversalContainer&) = 0;
+
+  private:
+    UniversalContainer current;
+    std::vector<UniversalContainer*> open; //collections being filled
+    std::string pending_key;
+    bool in_array; //inside the top level array
+
+    UniversalContainer& slot(void);
+    void end_collection(void);
+  };
+
+  //parse one JSON value, reporting it to the handler. Throws
+  //uce_Deserialization_Error on malformed input. The Buffer form
+  //leaves the read position just past the value. The FILE form may
+  //read beyond it.
+  void uc_parse_json(Buffer*, JSONHandler&);
+  void uc_parse_json(FILE*, JSONHandler&);
+
+} //end namespace
+
+#endif
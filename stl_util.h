@@ -55,13 +55,13 @@ std::vector<A> vector_sublist(const std::vector<A>& list, int start, int len)
 	return slist;
 }
 
-template<typename A, typename B>
-	bool compare_map(std::map<A,B>& map1, std::map<A,B>& map2)
+template<typename A, typename B, typename C, typename Al>
+	bool compare_map(std::map<A,B,C,Al>& map1, std::map<A,B,C,Al>& map2)
 {
 	if (map1.size() != map2.size()) return false;
 	
-	typename std::map<A,B>::const_iterator iter = map1.begin();
-	typename std::map<A,B>::const_iterator end = map1.end();
+	typename std::map<A,B,C,Al>::const_iterator iter = map1.begin();
+	typename std::map<A,B,C,Al>::const_iterator end = map1.end();
 	
 	bool same = true;
 	while (same && iter != end) {
@@ -71,8 +71,8 @@ template<typename A, typename B>
 	return same;
 }
 
-template<typename A>
-	bool compare_vector(std::vector<A>& list1, std::vector<A>& list2)
+template<typename A, typename Al>
+	bool compare_vector(std::vector<A,Al>& list1, std::vector<A,Al>& list2)
 {
 	size_t sz = list1.size();
 	if (sz != list2.size()) return false;
@@ -0,0 +1,462 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+/*
+  Round trip tests for the binary format and its options, UCView,
+  partial and lazy binary decoding, compressed frames, UCPath and JSON
+  string escapes. Run
+  with "make check". Prints each failed check and exits non-zero if
+  there were any.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <vector>
+#include "ucontainer.h"
+#include "ucio.h"
+#include "buffer.h"
+#include "ucpath.h"
+#include "ucview.h"
+#include "buffer_compress.h"
+
+using namespace std;
+using namespace JAD;
+
+static int failures = 0;
+
+#define CHECK(cond) \
+  do { if (!(cond)) { failures++; printf("%s:%d: failed: %s\n",__FILE__,__LINE__,#cond); } } while (0)
+
+static const int ALL_OPTIONS = uc_Binary_Offsets | uc_Binary_Keys | uc_Binary_Lengths;
+
+//true if decoding the bytes throws uce_Deserialization_Error
+static bool rejected(const char* data, size_t len)
+{
+  Buffer buffer(const_cast<char*>(data),len);
+  try {
+    uc_decode_binary(&buffer);
+  }
+  catch (UniversalContainer& uce) {
+    return (int) uce["code"] == uce_Deserialization_Error;
+  }
+  return false;
+}
+
+//a document with every type, sizes past one byte, and empty collections
+static UniversalContainer sample(void)
+{
+  UniversalContainer doc;
+  doc.init_map();
+  doc["user"]["id"] = 42L;
+  doc["user"]["name"] = "A somewhat long user name";
+  doc["user"]["ok"] = true;
+  doc["user"]["score"] = 0.1;
+  doc["user"]["half"] = 0.5;
+  doc["user"]["c"] = 'x';
+  doc["user"]["w"] = wstring(L"wide \x263A");
+  doc["user"]["nil"].clear();
+  doc["user"]["big"] = LONG_MIN;
+  doc["empty_a"].init_array();
+  doc["empty_m"].init_map();
+  doc["long"] = string(70000,'q');
+  for (int i = 0; i < 300; i++) {
+    UniversalContainer& r = doc["items"][i];
+    r["sku"] = (long) i * -7;
+    r["label"] = string(i % 40,'a' + i % 26);
+    if (i % 100 == 0) r["tags"][0] = "tag";
+  }
+  for (int i = 0; i < 150; i++) doc["keys"][string(i + 1,'k')] = i;
+  return doc;
+}
+
+//compares a view with the container it was encoded from, element by
+//element
+static void compare_view(const UCView& view, const UniversalContainer& uc)
+{
+  CHECK(view.exists());
+  CHECK(view.get_type() == uc.get_type());
+  if (uc.get_type() == uc_Map) {
+    vector<UniversalMapEntry> entries = uc.sorted_map_entries();
+    CHECK(view.size() == entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+      CHECK(view.key(i) == *entries[i].first);
+      compare_view(view[*entries[i].first],*entries[i].second);
+    }
+    CHECK(!view["no such key"].exists());
+  }
+  else if (uc.get_type() == uc_Array) {
+    CHECK(view.size() == uc.size());
+    UniversalContainer& array = const_cast<UniversalContainer&>(uc);
+    for (size_t i = 0; i < uc.size(); i++) compare_view(view[(int) i],array[(int) i]);
+    CHECK(!view[(int) uc.size()].exists());
+  }
+  else CHECK(view.decode() == uc);
+}
+
+static void test_integers(void)
+{
+  long values[] = {0,1,-1,63,-64,64,-65,127,128,300,-300,1L << 31,
+		   -(1L << 31) - 1,LONG_MAX,LONG_MIN};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    Buffer* b = uc_encode_binary(UniversalContainer(values[i]));
+    UniversalContainer back = uc_decode_binary(b);
+    CHECK(back.get_type() == uc_Integer && (long) back == values[i]);
+    CHECK(b->rpos == b->length);
+    delete b;
+  }
+  //small integers, negative or not, take a byte after the header,
+  //options and type
+  Buffer* b = uc_encode_binary(UniversalContainer(-5L));
+  CHECK(b->length == 4);
+  delete b;
+}
+
+static void test_binary(void)
+{
+  UniversalContainer doc = sample();
+  for (int options = 0; options <= ALL_OPTIONS; options++) {
+    Buffer* b = uc_encode_binary(doc,options);
+    CHECK((unsigned char) b->data[0] == 0x80 + uc_Binary_Version);
+    CHECK(b->data[1] == options);
+
+    CHECK(uc_decode_binary(b) == doc);
+    CHECK(b->rpos == b->length);
+    b->rewind();
+    {
+      UniversalContainer borrowed = uc_decode_binary_borrowed(b);
+      CHECK(borrowed == doc);
+    }
+
+    //each cut short blob is rejected
+    Buffer* whole = uc_encode_binary(doc,options);
+    for (size_t n = 0; n < whole->length; n += whole->length / 97 + 1)
+      CHECK(rejected(whole->data,n));
+    delete whole;
+    delete b;
+  }
+
+  //unknown versions and options are rejected
+  char future[] = {(char) 0x84,uc_Null};
+  CHECK(rejected(future,sizeof(future)));
+  char option[] = {(char) 0x83,0x40,uc_Null};
+  CHECK(rejected(option,sizeof(option)));
+
+  //version 1, with no header and four byte integers
+  char v1[] = {uc_Array,2,uc_Integer,0,0,0,0,uc_String,3,'a','b','c'};
+  int five = -5;
+  memcpy(v1 + 3,&five,sizeof(five));
+  Buffer old(v1,sizeof(v1));
+  UniversalContainer o = uc_decode_binary(&old);
+  CHECK(o.size() == 2 && (long) o[0] == -5 && (string) o[1] == "abc");
+
+  //version 2, with varints and no options byte
+  char v2[] = {(char) 0x82,uc_Array,1,uc_Integer,9};
+  Buffer two(v2,sizeof(v2));
+  CHECK((int) uc_decode_binary(&two)[0] == -5);
+  CHECK((int) UCView(v2,sizeof(v2))[0] == -5);
+}
+
+static void test_view(void)
+{
+  UniversalContainer doc = sample();
+  for (int options = 0; options <= ALL_OPTIONS; options++) {
+    Buffer* b = uc_encode_binary(doc,options);
+    UCView view(b);
+    compare_view(view,doc);
+    CHECK((long) view["user.id"] == 42);
+    CHECK((string) view["user.name"] == "A somewhat long user name");
+    CHECK(view["user.name"].length() == 25);
+    CHECK(!memcmp(view["user"]["name"].data(),"A somewhat",10));
+    CHECK((int) view[UCPath("items.123.sku")] == -861);
+    CHECK((string) view["items.200.tags.0"] == "tag");
+    CHECK(!view["items.300"].exists() && !view["user.missing.deeper"].exists());
+    CHECK(view["user.nil"].exists() && view["user.nil"].get_type() == uc_Null);
+    CHECK(view.decode() == doc);
+    delete b;
+  }
+}
+
+static void test_partial(void)
+{
+  UniversalContainer doc = sample();
+  UCPathSet paths;
+  paths.add("user.name");
+  paths.add("items.2.tags");
+  paths.add("keys.*");
+  UCPathSet all;
+  all.add("*");
+  for (int options = 0; options <= ALL_OPTIONS; options++) {
+    Buffer* b = uc_encode_binary(doc,options);
+    UniversalContainer part = uc_decode_binary(b,paths);
+    CHECK(b->rpos == b->length);
+    CHECK(part.size() == 3);
+    CHECK(part["user"].size() == 1 && part["user"]["name"] == doc["user"]["name"]);
+    CHECK(part["items"].size() == 3 && part["items"][0].get_type() == uc_Null);
+    CHECK(part["items"][2].size() == 0);
+    CHECK(part["keys"] == doc["keys"]);
+    b->rewind();
+    CHECK(uc_decode_binary(b,all) == doc);
+
+    b->rewind();
+    UniversalContainer lazy = uc_decode_binary_lazy(b);
+    CHECK(b->rpos == b->length);
+    delete b; //the lazy document keeps its own copy
+    CHECK((int) lazy["items"][123]["sku"] == -861);
+    CHECK(lazy == doc);
+  }
+
+  //a collection that does not end where its length says is rejected
+  UniversalContainer array;
+  array.init_array();
+  array.added_element() = 1;
+  array.added_element() = 2;
+  Buffer* b = uc_encode_binary(array,uc_Binary_Lengths);
+  b->data[3]++;
+  b->put((char) uc_Null);
+  CHECK(rejected(b->data,b->length));
+  delete b;
+}
+
+static void test_compression(void)
+{
+  UniversalContainer doc = sample();
+  string text;
+  for (int i = 0; text.size() < 3 * uc_Compress_Block + 7; i++) {
+    char tmp[48];
+    snprintf(tmp,sizeof(tmp),"{\"id\":%d,\"name\":\"n%d\"},",i,i % 13);
+    text += tmp;
+  }
+  vector<string> inputs;
+  inputs.push_back("");
+  inputs.push_back("x");
+  inputs.push_back(string(200000,'z'));
+  inputs.push_back(text);
+  inputs.push_back(text.substr(0,uc_Compress_Block));
+  string noise;
+  unsigned seed = 7;
+  for (int i = 0; i < 100000; i++) {
+    seed = seed * 1103515245 + 12345;
+    noise += (char) (seed >> 16);
+  }
+  inputs.push_back(noise);
+
+  for (int codec = uc_Codec_LZ4; codec <= uc_Codec_Zstd; codec++) {
+    if (!uc_codec_available(codec)) continue;
+    for (size_t i = 0; i < inputs.size(); i++) {
+      Buffer in(const_cast<char*>(inputs[i].data()),inputs[i].size());
+      Buffer* z = uc_compress(&in,codec);
+      CHECK(uc_is_compressed(z));
+      Buffer* back = uc_decompress(z);
+      CHECK(z->rpos == z->length);
+      CHECK(string(back->data,back->length) == inputs[i]);
+      for (size_t n = 4; n < z->length; n += z->length / 31 + 1) {
+	Buffer cut(z->data,n);
+	bool threw = false;
+	try {
+	  delete uc_decompress(&cut);
+	}
+	catch (UniversalContainer& uce) {
+	  threw = (int) uce["code"] == uce_Deserialization_Error;
+	}
+	CHECK(threw);
+      }
+      delete back;
+      delete z;
+    }
+    Buffer in(const_cast<char*>(text.data()),text.size());
+    Buffer* z = uc_compress(&in,codec);
+    CHECK(z->length * 3 < text.size());
+    delete z;
+
+    //the decoders read frames themselves
+    Buffer json;
+    {
+      UCCompressor out(&json,codec);
+      uc_encode_json(doc,out);
+      out.finish();
+    }
+    Buffer* plain = uc_encode_json(doc);
+    CHECK(uc_decode_json(&json,uc_JSON_Indexed) == uc_decode_json(plain,uc_JSON_Indexed));
+    CHECK(json.rpos == json.length);
+    json.rewind();
+    plain->rewind();
+    CHECK(uc_decode_json(&json,uc_JSON_Lexer) == uc_decode_json(plain,uc_JSON_Lexer));
+    CHECK(json.rpos == json.length);
+    json.rewind();
+    plain->rewind();
+    CHECK(uc_decode_json_lazy(&json) == uc_decode_json(plain,uc_JSON_Indexed));
+    delete plain;
+    for (size_t n = 4; n < json.length; n += json.length / 17 + 1) {
+      Buffer cut(json.data,n);
+      bool threw = false;
+      try {
+	uc_decode_json(&cut,uc_JSON_Lexer);
+      }
+      catch (UniversalContainer& uce) {
+	threw = (int) uce["code"] == uce_Deserialization_Error;
+      }
+      CHECK(threw);
+    }
+
+    //the binary decoder reads the blocks as they come, whatever the
+    //options
+    for (int options = 0; options <= ALL_OPTIONS; options++) {
+      Buffer* bin = uc_encode_binary(doc,options);
+      Buffer* packed = uc_compress(bin,codec);
+      packed->put_data("!",1);
+      CHECK(uc_decode_binary(packed) == doc);
+      CHECK(packed->rpos == packed->length - 1);
+      packed->rewind();
+      CHECK(uc_decode_binary_borrowed(packed) == doc);
+      packed->rewind();
+      CHECK(uc_decode_binary_lazy(packed) == doc);
+      CHECK(packed->rpos == packed->length - 1);
+      for (size_t n = 4; n < packed->length - 1; n += packed->length / 13 + 1) {
+	Buffer cut(packed->data,n);
+	bool threw = false;
+	try {
+	  uc_decode_binary(&cut);
+	}
+	catch (UniversalContainer& uce) {
+	  threw = (int) uce["code"] == uce_Deserialization_Error;
+	}
+	CHECK(threw);
+      }
+      delete packed;
+      delete bin;
+    }
+  }
+
+  //an LZ4 level above 1 gives up ratio for speed, and reads back the
+  //same
+  Buffer in(const_cast<char*>(text.data()),text.size());
+  Buffer* fast = uc_compress(&in,uc_Codec_LZ4,8);
+  Buffer* back = uc_decompress(fast);
+  CHECK(string(back->data,back->length) == text);
+  delete back;
+  delete fast;
+  CHECK(uc_codec_available(uc_Codec_LZ4));
+  CHECK(!uc_codec_available(0));
+
+  //a block claiming more than uc_Compress_Block is refused before
+  //anything is allocated for it, whichever decoder sees it
+  size_t claims[] = {uc_Compress_Block + 1,(size_t) 1 << 40,((size_t) 1 << 63) + 1};
+  for (size_t i = 0; i < sizeof(claims) / sizeof(claims[0]); i++) {
+    string frame("\xFFUZ\x01");
+    for (size_t v = claims[i]; v >= 0x80; v >>= 7) frame += (char) (v | 0x80);
+    frame += (char) (claims[i] >> (7 * (frame.size() - 4)));
+    frame += string(2,'\0');
+    for (int decoder = 0; decoder < 3; decoder++) {
+      Buffer in(const_cast<char*>(frame.data()),frame.size());
+      bool threw = false;
+      try {
+	if (decoder == 0) delete uc_decompress(&in);
+	else if (decoder == 1) uc_decode_json(&in);
+	else uc_decode_binary(&in);
+      }
+      catch (UniversalContainer& uce) {
+	threw = (int) uce["code"] == uce_Deserialization_Error;
+      }
+      CHECK(threw);
+    }
+  }
+}
+
+static void test_paths(void)
+{
+  UniversalContainer doc = sample();
+  const char* names[] = {"user.name","items.17.label","items.200.tags.0","keys.kkk","user.nil"};
+  UniversalContainer* nodes[] = {&doc["user"]["name"],&doc["items"][17]["label"],
+				 &doc["items"][200]["tags"][0],&doc["keys"]["kkk"],
+				 &doc["user"]["nil"]};
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    UCPath path(names[i]);
+    CHECK(path.to_string() == names[i]);
+    CHECK(path.exists(doc));
+    CHECK(path.find(doc) == nodes[i]);
+    CHECK(&path.get(doc) == nodes[i]);
+  }
+  UCPath missing("user.nope.deeper");
+  CHECK(!missing.exists(doc) && missing.find(doc) == NULL);
+  CHECK(UCPath("a.b.c").length() == 3);
+
+  //a numeric segment on a map is a key
+  UniversalContainer map;
+  map.init_map();
+  map["7"] = "seven";
+  CHECK((string) *UCPath("7").find(map) == "seven");
+
+  //json projection follows the same paths
+  Buffer* json = uc_encode_json(doc);
+  UCPathSet paths;
+  paths.add("user.id");
+  paths.add("items.*.sku");
+  UniversalContainer part = uc_decode_json(json,paths);
+  CHECK(part.size() == 2 && (long) part["user"]["id"] == 42);
+  CHECK(part["items"].size() == 300 && (long) part["items"][299]["sku"] == -2093);
+  CHECK(part["items"][5].size() == 1);
+  delete json;
+}
+
+//control characters come out as escapes, and NaN has no JSON form
+static void test_json_escapes(void)
+{
+  UniversalContainer doc;
+  doc.init_map();
+  string text("a\x01" "b\x1f\n",5);
+  doc["k"] = text;
+  Buffer* json = uc_encode_json(doc);
+  CHECK(string(json->data,json->wpos) == "{\"k\":\"a\\u0001b\\u001F\\n\"}");
+  for (int engine = uc_JSON_Lexer; engine <= uc_JSON_Indexed; engine++) {
+    json->rewind();
+    CHECK((string) uc_decode_json(json,engine)["k"] == text);
+  }
+  delete json;
+
+  UniversalContainer nan;
+  nan[0] = 0.0;
+  nan[0] = (double) nan[0] / 0.0;
+  bool threw = false;
+  try {
+    delete uc_encode_json(nan);
+  }
+  catch (UniversalContainer& uce) {
+    threw = (int) uce["code"] == uce_Serialization_Error;
+  }
+  CHECK(threw);
+}
+
+typedef void (*Test)(void);
+
+int main(int argc, char** argv)
+{
+  Test tests[] = {test_integers,test_binary,test_view,test_partial,
+		  test_compression,test_paths,test_json_escapes};
+  const char* names[] = {"integers","binary","view","partial",
+			 "compression","paths","json escapes"};
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    try {
+      tests[i]();
+    }
+    catch (UniversalContainer& uce) {
+      failures++;
+      Buffer* b = uc_encode_json(uce);
+      printf("%s: uncaught exception %.*s\n",names[i],(int) b->length,b->data);
+      delete b;
+    }
+  }
+  if (failures) {
+    printf("%d checks failed\n",failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+#include <cstdlib>
+#include "ucarena.h"
+
+namespace JAD {
+
+  //every block handed out is aligned to this
+  static const size_t ARENA_ALIGN = 16;
+
+  static size_t align_up(size_t n)
+  {
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  }
+
+  static __thread UCArena* current_arena = NULL;
+
+  UCArena::UCArena(size_t size)
+  {
+    chunks = NULL;
+    releases = NULL;
+    pos = end = NULL;
+    chunk_size = size;
+    allocated = 0;
+    self_contained = true;
+  }
+
+  UCArena::~UCArena(void)
+  {
+    for (Release* r = releases; r; r = r->next)
+      r->release(r->arg);
+    while (chunks) {
+      Chunk* next = chunks->next;
+      free(chunks);
+      chunks = next;
+    }
+  }
+
+  char* UCArena::new_chunk(size_t size)
+  {
+    Chunk* c = static_cast<Chunk*>(malloc(size));
+    if (!c) throw std::bad_alloc();
+    c->next = chunks;
+    chunks = c;
+    return reinterpret_cast<char*>(c);
+  }
+
+  void* UCArena::allocate(size_t n)
+  {
+    n = align_up(n ? n : 1);
+    allocated += n;
+    if (n > (size_t)(end - pos)) {
+      size_t header = align_up(sizeof(Chunk));
+      //big requests get a chunk of their own, leaving the current
+      //chunk to serve the small ones
+      if (n > chunk_size / 2)
+	return new_chunk(header + n) + header;
+      char* c = new_chunk(header + chunk_size);
+      pos = c + header;
+      end = pos + chunk_size;
+    }
+    void* p = pos;
+    pos += n;
+    return p;
+  }
+
+  //the list lives in the arena itself
+  void UCArena::at_release(void (*release)(void*), void* arg)
+  {
+    Release* r = static_cast<Release*>(allocate(sizeof(Release)));
+    r->next = releases;
+    r->release = release;
+    r->arg = arg;
+    releases = r;
+  }
+
+  void* UCArena::last_release(void (*release)(void*)) const
+  {
+    return releases && releases->release == release ? releases->arg : NULL;
+  }
+
+  size_t UCArena::bytes_allocated(void) const
+  {
+    return allocated;
+  }
+
+  UCArena* UCArena::current(void)
+  {
+    return current_arena;
+  }
+
+  UCArenaScope::UCArenaScope(UCArena& arena)
+  {
+    previous = current_arena;
+    current_arena = &arena;
+  }
+
+  UCArenaScope::UCArenaScope(UCArena* arena)
+  {
+    previous = current_arena;
+    current_arena = arena;
+  }
+
+  UCArenaScope::~UCArenaScope(void)
+  {
+    current_arena = previous;
+  }
+
+} //end namespace
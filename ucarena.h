@@ -0,0 +1,172 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+/*
+  Arena allocation for UniversalContainers, used when the library is
+  built with UC_ARENA.
+
+  While a UCArenaScope is active on a thread, containers made on that
+  thread carve their long strings, maps and arrays out of its UCArena
+  instead of the global heap, and so do the elements added to those
+  maps and arrays. Containers made before the scope, and the elements
+  of their collections, stay on the heap even when written to inside
+  it. An element always uses the arena of the collection holding it,
+  whichever scope is active when it is written. Freeing arena memory
+  does nothing; it is all handed back at once when the arena is
+  destroyed.
+
+  While nothing in the arena refers to memory outside it, a collection
+  in the arena is freed without destroying its elements, so freeing a
+  document costs the same however big it is. Heap strings, wide
+  strings, keys too long for the string itself, lazily decoded
+  collections and containers shared in from outside all refer to
+  outside memory. Once any is added, every container in the arena is
+  destroyed as usual, so that memory is released.
+
+  A UCArena is not thread safe, and every container built in it must
+  be destroyed before it is.
+*/
+
+#ifndef _UCARENA_H_
+#define _UCARENA_H_
+
+#include <cstddef>
+#include <new>
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif
+
+namespace JAD {
+
+  class UCArena {
+  public:
+    UCArena(size_t chunk_size = 64 * 1024);
+    ~UCArena(void);
+
+    void* allocate(size_t);
+    size_t bytes_allocated(void) const;
+
+    //something in the arena now refers to memory outside it
+    void add_external(void) { self_contained = false; }
+    bool has_external(void) const { return !self_contained; }
+
+    //runs release(arg) when the arena is destroyed, before its memory
+    //is handed back
+    void at_release(void (*release)(void*), void* arg);
+    //the arg of the release added last, if it runs release, or NULL
+    void* last_release(void (*release)(void*)) const;
+
+    //the arena of the innermost active scope on this thread, or NULL
+    static UCArena* current(void);
+
+  private:
+    friend class UCArenaScope;
+
+    struct Chunk {
+      Chunk* next;
+    };
+
+    struct Release {
+      Release* next;
+      void (*release)(void*);
+      void* arg;
+    };
+
+    Chunk* chunks;
+    Release* releases;
+    char* pos;
+    char* end;
+    size_t chunk_size;
+    size_t allocated;
+    bool self_contained;
+
+    char* new_chunk(size_t);
+    UCArena(const UCArena&);
+    void operator=(const UCArena&);
+  };
+
+  //routes allocations on this thread to arena for its lifetime. Given
+  //NULL, it routes them to the global heap, inside an outer scope.
+  class UCArenaScope {
+  public:
+    UCArenaScope(UCArena& arena);
+    explicit UCArenaScope(UCArena* arena);
+    ~UCArenaScope(void);
+
+  private:
+    UCArena* previous;
+
+    UCArenaScope(const UCArenaScope&);
+    void operator=(const UCArenaScope&);
+  };
+
+  /*
+    STL allocator for the collections behind UniversalContainers. It
+    remembers the arena that was current when it was made, so a
+    collection keeps using that arena as it grows, and uses the
+    global heap when there was none.
+  */
+  template <typename T>
+  class UCAllocator {
+  public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+#if __cplusplus >= 201103L
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+#endif
+
+    template <typename U>
+    struct rebind {
+      typedef UCAllocator<U> other;
+    };
+
+    UCArena* arena;
+
+    UCAllocator(void) : arena(UCArena::current()) {}
+    UCAllocator(const UCAllocator& a) : arena(a.arena) {}
+    template <typename U>
+    UCAllocator(const UCAllocator<U>& a) : arena(a.arena) {}
+
+    pointer allocate(size_type n, const void* = 0)
+    {
+      if (arena) return static_cast<pointer>(arena->allocate(n * sizeof(T)));
+      return static_cast<pointer>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(pointer p, size_type)
+    {
+      if (!arena) ::operator delete(p);
+    }
+
+    size_type max_size(void) const { return size_type(-1) / sizeof(T); }
+
+#if __cplusplus < 201103L
+    //C++11 library code constructs elements itself, and would
+    //otherwise copy where it could move
+    pointer address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+    void construct(pointer p, const T& v) { new(static_cast<void*>(p)) T(v); }
+    void destroy(pointer p) { p->~T(); }
+#endif
+
+    template <typename U>
+    bool operator==(const UCAllocator<U>& a) const { return arena == a.arena; }
+    template <typename U>
+    bool operator!=(const UCAllocator<U>& a) const { return arena != a.arena; }
+  };
+
+} //end namespace
+
+#endif
@@ -19,19 +19,21 @@ namespace JAD {
     unsigned result = 0;
     unsigned req_count = 0;
     
-    UniversalMap::iterator it = uc.map_begin();
-    UniversalMap::iterator eit = uc.map_end(); 
+    //read through the entries, since the iterators would pin the map
+    //for dirty tracking
+    std::vector<UniversalMapEntry> entries = uc.sorted_map_entries();
     
     ContractMap* required = constraints.map_constraints.require_map;
     ContractMap* optional = constraints.map_constraints.optional_map;
     
-    for (; it != eit; it++) {
-      if (required && required->count(it->first) > 0) {
+    for (size_t i = 0; i < entries.size(); i++) {
+      const std::string& key = *entries[i].first;
+      if (required && required->count(key) > 0) {
 	req_count++;
-	result |= required->operator[](it->first)->compare(it->second);
+	result |= required->operator[](key)->compare(*entries[i].second);
       }
-      else if (optional && optional->count(it->first) > 0) {
-	result |= optional->operator[](it->first)->compare(it->second);
+      else if (optional && optional->count(key) > 0) {
+	result |= optional->operator[](key)->compare(*entries[i].second);
       }
       else {
 	result |= ucc_EXTRA_MAP_ELEMENT;
@@ -48,17 +50,18 @@ namespace JAD {
     if (data_type != uc_Array || uc.get_type() != uc_Array) return 0;
     unsigned result = 0;
     UniversalContainer tmp = (long int) uc.size();
-    UniversalArray::iterator it;
-    UniversalArray::iterator eit = uc.vector_end();
+    //a copy sharing the elements, read by index rather than through
+    //the iterators, which would pin the array for dirty tracking
+    UniversalContainer items(uc);
+    int n = uc.size();
     
     if (constraints.array_constraints.size) 
       result |= constraints.array_constraints.size->compare(tmp);
  
     
     if (constraints.array_constraints.forall) {
-      it = uc.vector_begin();
-      for (;it < eit; it++)
-	result |= constraints.array_constraints.forall->compare(*it);
+      for (int i = 0; i < n; i++)
+	result |= constraints.array_constraints.forall->compare(items[i]);
     }
     
     if (constraints.array_constraints.exists) {
@@ -66,10 +69,9 @@ namespace JAD {
       ContractVector::iterator exists_list_eit = constraints.array_constraints.exists->end();
       
       for (; exists_list_it < exists_list_eit; exists_list_it++) {	
-	it = uc.vector_begin();
 	bool found = false;
-	for (;it < eit && !found; it++)
-	  found = (*exists_list_it)->compare(*it) == 0;
+	for (int i = 0; i < n && !found; i++)
+	  found = (*exists_list_it)->compare(items[i]) == 0;
 	if (!found)
 	  result |= ucc_MISSING_REQUIRED_ARRAY_ELEMENT;
       }
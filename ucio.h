@@ -14,11 +14,14 @@
 #define _UCIO_H_
 
 #include <string>
+#include <cstdio>
+#include <iosfwd>
 
 namespace JAD {
 
   class UniversalContainer;
   class Buffer;
+  class UCPathSet;
 
   //prototypes for serializers and deserializers
   UniversalContainer uc_decode_ini(Buffer*);
@@ -27,11 +30,73 @@ namespace JAD {
   UniversalContainer uc_decode_form(Buffer*);
   Buffer* uc_encode_form(const UniversalContainer& uc);
   
+  //the binary format written. uc_decode_binary also reads the
+  //earlier versions.
+  const int uc_Binary_Version = 3;
+  //binary encoding options
+  const int uc_Binary_Offsets = 1; //offset tables, for UCView
+  const int uc_Binary_Keys = 2; //each distinct map key written once
+  const int uc_Binary_Lengths = 4; //collections lead with their size in bytes
   UniversalContainer uc_decode_binary(Buffer*);
-  Buffer* uc_encode_binary(const UniversalContainer&);
+  Buffer* uc_encode_binary(const UniversalContainer&, int options = 0);
+  //appends to an existing buffer
+  void uc_encode_binary(const UniversalContainer&, Buffer*, int options = 0);
 
   UniversalContainer uc_decode_json(Buffer*);
   Buffer* uc_encode_json(const UniversalContainer&);
+  //appends to an existing buffer
+  void uc_encode_json(const UniversalContainer&, Buffer*);
+
+  //receives encoded output a chunk at a time, as it is made
+  class UCOutput {
+  public:
+    virtual ~UCOutput(void) {}
+    virtual void write(const char* data, size_t len) = 0;
+  };
+
+  //encode straight to an output, writing chunk bytes at a time
+  //rather than holding the whole document. A failed write throws
+  //uce_Serialization_Error.
+  const size_t uc_Output_Chunk = 64 * 1024;
+  void uc_encode_json(const UniversalContainer&, UCOutput&,
+		      size_t chunk = uc_Output_Chunk);
+  void uc_encode_json(const UniversalContainer&, int fd,
+		      size_t chunk = uc_Output_Chunk);
+  void uc_encode_json(const UniversalContainer&, FILE*,
+		      size_t chunk = uc_Output_Chunk);
+  void uc_encode_json(const UniversalContainer&, std::ostream&,
+		      size_t chunk = uc_Output_Chunk);
+
+  //JSON decoding engines. uc_decode_json(Buffer*) uses the lexer,
+  //unless the library is built with UC_JSON_INDEXED. Input too long
+  //for the index goes to the lexer either way.
+  const int uc_JSON_Lexer = 0;   //the flex scanner
+  const int uc_JSON_Indexed = 1; //the vectorized two pass decoder
+  const int uc_JSON_Lazy = 2;    //uc_decode_json_lazy
+  UniversalContainer uc_decode_json(Buffer*, int engine);
+
+  //decoders that leave long strings in the buffer instead of copying
+  //them. The buffer is rewritten in place, and must not be changed or
+  //freed while the decoded containers, or any copies of them, exist.
+  UniversalContainer uc_decode_json_borrowed(Buffer*);
+  UniversalContainer uc_decode_binary_borrowed(Buffer*);
+
+  //indexes the JSON, but makes the elements of each map and array
+  //only when something first looks at them. The text is copied, so
+  //the buffer may go away. Errors in parts not yet looked at are
+  //thrown when those parts are first used.
+  UniversalContainer uc_decode_json_lazy(Buffer*);
+  //the same for the binary form. The value's bytes are copied, and a
+  //collection is stepped over in one jump if it was written with
+  //uc_Binary_Lengths.
+  UniversalContainer uc_decode_binary_lazy(Buffer*);
+
+  //decodes only the elements named by paths (see UCPathSet in
+  //ucpath.h), stepping over the rest of the input without making it
+  UniversalContainer uc_decode_json(Buffer*, const UCPathSet& paths);
+  //with uc_Binary_Lengths, collections off the paths are stepped over
+  //without reading them
+  UniversalContainer uc_decode_binary(Buffer*, const UCPathSet& paths);
 
   //basic print function
   void print(UniversalContainer&);
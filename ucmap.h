@@ -0,0 +1,251 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+/*
+  Open addressing hash map, used as the UniversalMap backend when the
+  library is built with UC_HASH_MAP. It covers the subset of the
+  std::map interface that libuc and its users rely on.
+
+  Entries are kept packed in a vector, so iteration walks contiguous
+  memory in insertion order. A separate table of slots, probed
+  linearly, maps a key's hash to its entry. Erasing an entry moves the
+  last entry into its place, so erasing changes the iteration order,
+  and invalidates iterators, as does any insertion. Since an insertion
+  may also reallocate the vector, operator[] and insert invalidate
+  references and pointers to values already in the map, not just
+  iterators. Erasing invalidates those to the last entry, which moves.
+*/
+
+#ifndef _UCMAP_H_
+#define _UCMAP_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <memory>
+
+namespace JAD {
+
+  template <typename V, template <typename> class Alloc = std::allocator>
+  class UCHashMap {
+  public:
+    typedef std::string key_type;
+    typedef V mapped_type;
+    typedef std::pair<std::string,V> value_type;
+    typedef std::vector<value_type,Alloc<value_type> > entry_vector;
+    typedef typename entry_vector::iterator iterator;
+    typedef typename entry_vector::const_iterator const_iterator;
+
+    iterator begin(void) { return entries.begin(); }
+    iterator end(void) { return entries.end(); }
+    const_iterator begin(void) const { return entries.begin(); }
+    const_iterator end(void) const { return entries.end(); }
+    size_t size(void) const { return entries.size(); }
+    bool empty(void) const { return entries.empty(); }
+
+    void clear(void)
+    {
+      entries.clear();
+      slots.clear();
+    }
+
+    iterator find(const std::string& key)
+    {
+      size_t s = lookup(key,hash_key(key));
+      if (s == NOT_FOUND) return entries.end();
+      return entries.begin() + (slots[s].entry - 1);
+    }
+
+    const_iterator find(const std::string& key) const
+    {
+      size_t s = lookup(key,hash_key(key));
+      if (s == NOT_FOUND) return entries.end();
+      return entries.begin() + (slots[s].entry - 1);
+    }
+
+    size_t count(const std::string& key) const
+    {
+      return lookup(key,hash_key(key)) == NOT_FOUND ? 0 : 1;
+    }
+
+    std::pair<iterator,bool> insert(const value_type& kv)
+    {
+      unsigned h = hash_key(kv.first);
+      size_t s = lookup(kv.first,h);
+      if (s != NOT_FOUND)
+	return std::make_pair(entries.begin() + (slots[s].entry - 1),false);
+      entries.push_back(kv);
+      place(h,entries.size());
+      return std::make_pair(entries.end() - 1,true);
+    }
+
+    V& operator[](const std::string& key)
+    {
+      unsigned h = hash_key(key);
+      size_t s = lookup(key,h);
+      if (s != NOT_FOUND) return entries[slots[s].entry - 1].second;
+      entries.push_back(value_type(key,V()));
+      place(h,entries.size());
+      return entries.back().second;
+    }
+
+    void erase(iterator pos)
+    {
+      erase_entry(pos - entries.begin());
+    }
+
+    size_t erase(const std::string& key)
+    {
+      size_t s = lookup(key,hash_key(key));
+      if (s == NOT_FOUND) return 0;
+      erase_entry(slots[s].entry - 1);
+      return 1;
+    }
+
+  private:
+    //entry is an index into entries, plus one. Zero marks a free slot.
+    struct Slot {
+      unsigned hash;
+      unsigned entry;
+    };
+
+    static const size_t NOT_FOUND = (size_t) -1;
+
+    entry_vector entries;
+    std::vector<Slot,Alloc<Slot> > slots; //always empty or a power of two in size
+
+    //FNV-1a
+    static unsigned hash_key(const std::string& key)
+    {
+      unsigned h = 2166136261U;
+      for (size_t i = 0; i < key.length(); i++) {
+	h ^= (unsigned char) key[i];
+	h *= 16777619U;
+      }
+      return h;
+    }
+
+    size_t lookup(const std::string& key, unsigned h) const
+    {
+      if (slots.empty()) return NOT_FOUND;
+      size_t mask = slots.size() - 1;
+      for (size_t s = h & mask; slots[s].entry; s = (s + 1) & mask)
+	if (slots[s].hash == h && entries[slots[s].entry - 1].first == key)
+	  return s;
+      return NOT_FOUND;
+    }
+
+    //the table is kept at most half full
+    void place(unsigned h, size_t entry)
+    {
+      if (slots.size() < entries.size() * 2) grow();
+      size_t mask = slots.size() - 1;
+      size_t s = h & mask;
+      while (slots[s].entry) s = (s + 1) & mask;
+      slots[s].hash = h;
+      slots[s].entry = entry;
+    }
+
+    void grow(void)
+    {
+      size_t nsize = slots.empty() ? 8 : slots.size() * 2;
+      while (nsize < entries.size() * 2) nsize <<= 1;
+      //made with the table's allocator, which the swap hands back
+      std::vector<Slot,Alloc<Slot> > old(slots.get_allocator());
+      old.swap(slots);
+      Slot empty = {0,0};
+      slots.assign(nsize,empty);
+      size_t mask = nsize - 1;
+      for (size_t i = 0; i < old.size(); i++) {
+	if (!old[i].entry) continue;
+	size_t s = old[i].hash & mask;
+	while (slots[s].entry) s = (s + 1) & mask;
+	slots[s] = old[i];
+      }
+    }
+
+    //the slot pointing at entry idx
+    size_t slot_for_entry(size_t idx) const
+    {
+      size_t mask = slots.size() - 1;
+      size_t s = hash_key(entries[idx].first) & mask;
+      while (slots[s].entry != idx + 1) s = (s + 1) & mask;
+      return s;
+    }
+
+    //empties a slot, shifting back any later members of its probe
+    //run so that lookups need no tombstones
+    void free_slot(size_t hole)
+    {
+      size_t mask = slots.size() - 1;
+      size_t s = (hole + 1) & mask;
+      while (slots[s].entry) {
+	size_t home = slots[s].hash & mask;
+	if (((s - home) & mask) >= ((s - hole) & mask)) {
+	  slots[hole] = slots[s];
+	  hole = s;
+	}
+	s = (s + 1) & mask;
+      }
+      slots[hole].entry = 0;
+    }
+
+    void erase_entry(size_t idx)
+    {
+      size_t last = entries.size() - 1;
+      free_slot(slot_for_entry(idx));
+      if (idx != last) {
+	slots[slot_for_entry(last)].entry = idx + 1;
+#ifdef UC_MOVE_SEMANTICS
+	entries[idx] = std::move(entries[last]);
+#else
+	entries[idx] = entries[last];
+#endif
+      }
+      entries.pop_back();
+    }
+  };
+
+} //end namespace
+
+/*
+  Counterparts to the std::map templates in stl_util.h.
+*/
+
+template <typename V, template <typename> class A>
+std::vector<std::string> keys_for_map(const JAD::UCHashMap<V,A>& map)
+{
+  std::vector<std::string> list;
+  typename JAD::UCHashMap<V,A>::const_iterator iter = map.begin();
+  typename JAD::UCHashMap<V,A>::const_iterator end = map.end();
+
+  for (;iter != end; iter++)
+    list.push_back(iter->first);
+
+  return list;
+}
+
+template <typename V, template <typename> class A>
+bool compare_map(const JAD::UCHashMap<V,A>& map1, const JAD::UCHashMap<V,A>& map2)
+{
+  if (map1.size() != map2.size()) return false;
+
+  typename JAD::UCHashMap<V,A>::const_iterator iter = map1.begin();
+  typename JAD::UCHashMap<V,A>::const_iterator end = map1.end();
+  typename JAD::UCHashMap<V,A>::const_iterator other;
+
+  for (;iter != end; iter++) {
+    other = map2.find(iter->first);
+    if (other == map2.end() || !(iter->second == other->second))
+	return false;
+  }
+  return true;
+}
+
+#endif
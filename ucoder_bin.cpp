@@ -8,8 +8,14 @@
  */
 
 #include <string>
+#include <cstring>
+#include <map>
 #include "ucontainer.h"
 #include "buffer.h"
+#include "ucio.h"
+#include "ucpath.h"
+#include "ucview.h"
+#include "buffer_compress.h"
 
 using namespace std;
 
@@ -20,121 +26,320 @@ using namespace std;
 
 namespace JAD {
 
-//Binary encoder users sn1 style size fields. If high bit of first
-//byte is not set, then that byte is the size. If the high bit is
-//set, then clear the bit to determine the number of bytes that
-//encode the size.
+/*
+  The binary form starts with a header byte, 0x80 plus the format
+  version, then a byte of uc_Binary_ options. Each container is then a
+  type byte followed by its value. Integers, sizes and the characters
+  of wide strings are LEB128 varints, seven bits to a byte, low bits
+  first, with the high bit set on every byte but the last. Integers are
+  zigzagged first, so small negative numbers stay short too. A real
+  that a float holds exactly is written in four bytes, under its own
+  type byte. Map entries are a key, as a size and its bytes, then the
+  value, in key order.
+
+  With uc_Binary_Offsets, a map or array that is not empty follows its
+  count with a byte giving the width of an offset, 1, 2, 4 or 8, and a
+  table of little endian offsets of that width, one for each entry.
+  Offsets count from the end of the table.
+
+  With uc_Binary_Keys, the options byte is followed by a table of every
+  distinct map key, in order: a count, an offset table as above when
+  uc_Binary_Offsets is also set, and the keys. A map entry then gives
+  its key as an index into the table. Since the table is in order, the
+  entries of a map are still in order of their indexes.
+
+  With uc_Binary_Lengths, the type byte of every map and array is
+  followed by the number of bytes in the rest of it, its count, table
+  and entries, so a reader can step over the whole collection at once.
+
+  Version 2 had no options byte, and never has offset tables. Version
+  1 had no header, and its first byte is always a type, which is below
+  0x80. Its integers were four byte ints, and its sizes a length byte
+  and up to four big endian bytes. Both are still read.
+*/
 
-  void put_size_field(Buffer* buffer, size_t size)
+  const unsigned char bin_Header = 0x80;
+  const char bin_Float = 7; //a real stored as a float
+  const int bin_Options = uc_Binary_Offsets | uc_Binary_Keys | uc_Binary_Lengths;
+
+  //what decoding needs to know about the blob as a whole
+  struct BinFormat {
+    int version;
+    int options;
+    vector<string> keys; //the key table, if there is one
+  };
+
+  static void put_varint(Buffer* buffer, unsigned long v)
   {
-    unsigned char bt;
-    unsigned tmp = 0;
-    
-    if (size < 128) {
-      bt = (unsigned char) size;
-      if (!buffer->put(bt)) throw ucexception(uce_Serialization_Error);
-      return;
+    if (!buffer->ensure_space(sizeof(v) * 8 / 7 + 1))
+      throw ucexception(uce_Serialization_Error);
+    unsigned char* out = (unsigned char*) buffer->data + buffer->wpos;
+    while (v >= 0x80) {
+      *out++ = (unsigned char) (v | 0x80);
+      v >>= 7;
     }
-    
-    unsigned char nb; //number of size bytes needed
-    if (size < 255) nb = 1;
-    else if (size < 255 * 255 - 1) nb = 2;
-    else if (size < 255 * 255 * 255 - 1) nb = 3;
-    else nb = 4;
-    //write the number of bytes needed to encode size
-    if (!buffer->put(128 + nb))
-       throw ucexception(uce_Serialization_Error); 
-    
-    for (;nb > 0; nb--) {
-      tmp >>= 8 * (nb-1); //shift top bit of size to bottom
-      tmp &= 0x000000FF; //clear out the rest
-      bt = (unsigned char) tmp;
-      if (!buffer->put(bt)) throw ucexception(uce_Serialization_Error); 
+    *out++ = (unsigned char) v;
+    buffer->wpos = (char*) out - buffer->data;
+    if (buffer->length < buffer->wpos) buffer->length = buffer->wpos;
+  }
+
+  static unsigned long read_varint(const unsigned char*& p, const unsigned char* end)
+  {
+    unsigned long v = 0;
+    for (unsigned shift = 0; p < end && shift < sizeof(v) * 8; shift += 7) {
+      v |= (unsigned long) (*p & 0x7F) << shift;
+      if (!(*p++ & 0x80)) return v;
     }
+    throw ucexception(uce_Deserialization_Error);
   }
-  
-  size_t get_size_field(Buffer* buffer)
+
+  /*
+    What decoding reads from: a buffer, or a compressed frame read
+    into a window. The window is topped up from the frame as reading
+    passes its end, after moving what is still unread to its front, so
+    it holds no more than a block or two and the value being read.
+    Positions count from the start of the input, so they hold as the
+    window moves on.
+   */
+  class BinInput {
+  public:
+    BinInput(Buffer* b) : buffer(b), frame(NULL), dropped(0) {}
+    BinInput(Buffer* window, UCFrameReader* f) : buffer(window), frame(f), dropped(0) {}
+
+    //the bytes at the read position, n of them if there are that many
+    //left, and otherwise as many as there are
+    const unsigned char* at(size_t n)
+    {
+      if (held() < n) more(n);
+      return (unsigned char*) buffer->data + buffer->rpos;
+    }
+    //how many bytes at() has to hand
+    size_t held(void) const { return buffer->length - buffer->rpos; }
+    //the bytes to the end of the input
+    size_t left(void) const { return held() + (frame ? frame->remaining() : 0); }
+    size_t pos(void) const { return dropped + buffer->rpos; }
+
+    template <typename T> bool fetch(T& v)
+    {
+      at(sizeof(v));
+      return buffer->fetch(v);
+    }
+    char* fetch_data(size_t len)
+    {
+      at(len);
+      return buffer->fetch_data(len);
+    }
+    //steps over n bytes, which must be left, a window at a time
+    void skip(size_t n)
+    {
+      while (n > held()) {
+	n -= held();
+	buffer->rpos = buffer->length;
+	more(n < uc_Compress_Block ? n : uc_Compress_Block);
+	if (!held()) throw ucexception(uce_Deserialization_Error);
+      }
+      buffer->rpos += n;
+    }
+
+  private:
+    Buffer* buffer;
+    UCFrameReader* frame;
+    size_t dropped; //the input before the window
+
+    //reads at least a block, so small reads do not each go to the
+    //frame
+    void more(size_t n)
+    {
+      if (!frame || !frame->remaining()) return;
+      size_t keep = held();
+      memmove(buffer->data,buffer->data + buffer->rpos,keep);
+      dropped += buffer->rpos;
+      buffer->rpos = 0;
+      buffer->wpos = buffer->length = keep;
+      size_t want = n - keep > uc_Compress_Block ? n - keep : uc_Compress_Block;
+      if (want > frame->remaining()) want = frame->remaining();
+      if (!buffer->ensure_space(want)) throw ucexception(uce_Deserialization_Error);
+      buffer->wpos = buffer->length = keep + frame->read(buffer->data + keep,want);
+    }
+  };
+
+  static unsigned long get_varint(BinInput& in)
   {
-    unsigned char tmp;
-    int nb;
-    size_t size = 0;
-    
-    if (!buffer->fetch(tmp)) throw ucexception(uce_Deserialization_Error);
-    if (tmp < 128) return (size_t) tmp;
-    
-    nb = tmp - 128;
-    for (int i = 0; i < nb; i++) {
-      if (!buffer->fetch(tmp)) throw ucexception(uce_Deserialization_Error);
-      size <<= 8;
-      size += tmp;
+    const unsigned char* p = in.at(sizeof(unsigned long) * 8 / 7 + 1);
+    const unsigned char* start = p;
+    unsigned long v = read_varint(p,p + in.held());
+    in.skip(p - start);
+    return v;
+  }
+
+  //0, -1, 1, -2, 2... become 0, 1, 2, 3, 4...
+  static unsigned long zigzag(long l)
+  {
+    return ((unsigned long) l << 1) ^ (unsigned long) (l >> (sizeof(l) * 8 - 1));
+  }
+
+  static long unzigzag(unsigned long v)
+  {
+    return (long) (v >> 1) ^ -(long) (v & 1);
+  }
+
+  //a size no larger than the bytes left to read, so a damaged size
+  //cannot ask for a huge allocation
+  static size_t get_size(BinInput& in, int version)
+  {
+    size_t size;
+    if (version > 1) size = get_varint(in);
+    else {
+      unsigned char tmp;
+      if (!in.fetch(tmp)) throw ucexception(uce_Deserialization_Error);
+      if (tmp < 128) return (size_t) tmp;
+      size = 0;
+      for (int i = 0; i < tmp - 128; i++) {
+	unsigned char bt;
+	if (!in.fetch(bt)) throw ucexception(uce_Deserialization_Error);
+	size = (size << 8) + bt;
+      }
     }
+    if (size > in.left())
+      throw ucexception(uce_Deserialization_Error);
     return size;
   }
+
+  //steps over the offset table of a collection of count entries
+  static void skip_offsets(BinInput& in, size_t count, int options)
+  {
+    unsigned char width;
+    if (!(options & uc_Binary_Offsets) || !count) return;
+    if (!in.fetch(width) || (width != 1 && width != 2 && width != 4 && width != 8) ||
+	in.left() / width < count)
+      throw ucexception(uce_Deserialization_Error);
+    in.skip(count * width);
+  }
   
-  UniversalContainer uc_decode_binary(Buffer* buffer)
+  //where the collection whose type byte was just read ends, if it
+  //was written with its length, or else 0
+  static size_t get_end(BinInput& in, const BinFormat& format)
+  {
+    if (!(format.options & uc_Binary_Lengths)) return 0;
+    size_t len = get_varint(in);
+    if (len > in.left()) throw ucexception(uce_Deserialization_Error);
+    return in.pos() + len;
+  }
+
+  //a collection must run exactly as long as it said
+  static void check_end(BinInput& in, size_t end)
+  {
+    if (end && in.pos() != end) throw ucexception(uce_Deserialization_Error);
+  }
+
+  static string get_key(BinInput& in, const BinFormat& format)
+  {
+    if (format.options & uc_Binary_Keys) {
+      unsigned long id = get_varint(in);
+      if (id >= format.keys.size()) throw ucexception(uce_Deserialization_Error);
+      return format.keys[id];
+    }
+    size_t sz = get_size(in,format.version);
+    char* tmp = in.fetch_data(sz);
+    if (!tmp) throw ucexception(uce_Deserialization_Error);
+    return string(tmp,sz);
+  }
+
+  //a borrowing decode moves each long string back one byte, over the
+  //end of its size field, to make room for a nul after it. Only a
+  //plain buffer may be borrowed from.
+  static UniversalContainer decode_binary(BinInput& in, bool borrow,
+					  const BinFormat& format)
   {
+    int version = format.version;
     UniversalContainerType type;
-    if (!buffer->fetch(type)) throw ucexception(uce_Deserialization_Error);
+    if (!in.fetch(type)) throw ucexception(uce_Deserialization_Error);
     char* tmp;
 
     UniversalContainer uc;
-    long l;
+    int i;
     char c;
     bool b;
     double r;
+    float f;
     string s;
     wstring w; 
     size_t len;
     size_t sz;
+    size_t end;
     
     switch(type) {
     case uc_Integer :
-      if (!buffer->fetch(l)) throw ucexception(uce_Deserialization_Error);
-      uc = l;
+      if (version > 1) uc = unzigzag(get_varint(in));
+      else {
+	if (!in.fetch(i)) throw ucexception(uce_Deserialization_Error);
+	uc = i;
+      }
       break;
     case uc_Boolean :
-      if (!buffer->fetch(b)) throw ucexception(uce_Deserialization_Error);
+      if (!in.fetch(b)) throw ucexception(uce_Deserialization_Error);
       uc = b;
       break;
     case uc_Character :
-      if (!buffer->fetch(c)) throw ucexception(uce_Deserialization_Error);
+      if (!in.fetch(c)) throw ucexception(uce_Deserialization_Error);
       uc = c;
       break;
     case uc_Real :
-      if (!buffer->fetch(r)) throw ucexception(uce_Deserialization_Error);
+      if (!in.fetch(r)) throw ucexception(uce_Deserialization_Error);
       uc = r;
       break;
+    case bin_Float :
+      tmp = in.fetch_data(sizeof(f));
+      if (!tmp || version < 2) throw ucexception(uce_Deserialization_Error);
+      memcpy(&f,tmp,sizeof(f));
+      uc = (double) f;
+      break;
     case uc_String :
-      sz = get_size_field(buffer);
-      tmp = buffer->fetch_data(sz);
+      sz = get_size(in,version);
+      tmp = in.fetch_data(sz);
       if (!tmp) throw ucexception(uce_Deserialization_Error);
+      if (borrow && sz > uc_Inline_Length) {
+	memmove(tmp - 1,tmp,sz);
+	tmp[sz - 1] = '\0';
+	uc.borrow_string(tmp - 1,sz);
+	break;
+      }
       s.clear();
       s.insert(0,tmp,sz);
       uc = s;
       break;
     case uc_WString :
-      sz = get_size_field(buffer);
-      tmp = buffer->fetch_data(sz*sizeof(wchar_t));
-      if (!tmp) throw ucexception(uce_Deserialization_Error);
-      w.clear();
-      w.insert(0,(wchar_t*)tmp,sz);
+      sz = get_size(in,version);
+      if (version > 1) {
+	w.resize(sz);
+	for (size_t j = 0; j < sz; j++) w[j] = (wchar_t) get_varint(in);
+      }
+      else {
+	tmp = in.fetch_data(sz*sizeof(wchar_t));
+	if (!tmp) throw ucexception(uce_Deserialization_Error);
+	w.insert(0,(wchar_t*)tmp,sz);
+      }
       uc = w;    
       break;
     case uc_Map :
-      len = get_size_field(buffer);
+      uc.init_map();
+      end = get_end(in,format);
+      len = get_size(in,version);
+      skip_offsets(in,len,format.options);
       for (size_t j = 0; j < len; j++) {
-	sz = get_size_field(buffer);
-	tmp = buffer->fetch_data(sz);
-	if (!tmp) throw ucexception(uce_Deserialization_Error);
-	s.clear();
-	s.insert(0,tmp,sz);
-	uc[s] = uc_decode_binary(buffer);
+	s = get_key(in,format);
+	uc[s] = decode_binary(in,borrow,format);
       }
+      check_end(in,end);
       break;
     case uc_Array :
-      len = get_size_field(buffer);
+      uc.init_array();
+      end = get_end(in,format);
+      len = get_size(in,version);
+      skip_offsets(in,len,format.options);
       for (size_t j = 0; j < len; j++) 
-	uc[j] = uc_decode_binary(buffer);
+	uc.added_element() = decode_binary(in,borrow,format);
+      check_end(in,end);
       break;
     case uc_Null :
       break;
@@ -143,27 +348,440 @@ namespace JAD {
     }
     return uc;
   }
+
+  //reads the header, if there is one, leaving data at the first type
+  //byte
+  static void read_header(const unsigned char*& data, const unsigned char* end,
+			  int& version, int& options)
+  {
+    version = 1;
+    options = 0;
+    if (data >= end || *data < bin_Header) return;
+    version = *data++ - bin_Header;
+    if (version == 3 && data < end) options = *data++;
+    else if (version != 2) throw ucexception(uce_Deserialization_Error);
+    if (options & ~bin_Options) throw ucexception(uce_Deserialization_Error);
+  }
+
+  static const unsigned char* skip_value(const unsigned char* p,
+					 const unsigned char* end, int options);
+
+  //reads the header and key table, leaving the read position at the
+  //first type byte. The table is read in order, a key at a time, so
+  //it can come from a window.
+  static void get_format(BinInput& in, BinFormat& format)
+  {
+    const unsigned char* p = in.at(2);
+    const unsigned char* start = p;
+    read_header(p,p + in.held(),format.version,format.options);
+    in.skip(p - start);
+    if (!(format.options & uc_Binary_Keys)) return;
+    size_t count = get_size(in,format.version);
+    skip_offsets(in,count,format.options);
+    format.keys.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      size_t len = get_size(in,format.version);
+      char* name = in.fetch_data(len);
+      if (!name) throw ucexception(uce_Deserialization_Error);
+      format.keys[i].assign(name,len);
+    }
+  }
+
+  //a compressed blob is decoded from a window on its blocks as they
+  //are decompressed. The window moves, so nothing may borrow from it.
+  static UniversalContainer decode_binary(Buffer* buffer, bool borrow)
+  {
+    BinFormat format;
+    if (uc_is_compressed(buffer)) {
+      UCFrameReader frame(buffer);
+      Buffer window((int) (2 * uc_Compress_Block));
+      BinInput in(&window,&frame);
+      get_format(in,format);
+      UniversalContainer uc = decode_binary(in,false,format);
+      frame.finish();
+      return uc;
+    }
+    BinInput in(buffer);
+    get_format(in,format);
+    return decode_binary(in,borrow,format);
+  }
   
-  void uc_encode_binary(const UniversalContainer& uc, Buffer* buffer)
+  UniversalContainer uc_decode_binary(Buffer* buffer)
+  {
+    return decode_binary(buffer,false);
+  }
+
+  UniversalContainer uc_decode_binary_borrowed(Buffer* buffer)
+  {
+    return decode_binary(buffer,true);
+  }
+
+  /*
+    The tape behind a lazily decoded value: a copy of its bytes, and
+    the key table. Every collection not yet filled holds a reference.
+   */
+  struct BinaryTape {
+    unsigned refcount;
+    vector<char> data;
+    BinFormat format;
+
+    BinaryTape(void) : refcount(1) {}
+  };
+
+  //collections sharing a tape may be filled, and freed, on different
+  //threads. Filling only reads the tape, and fill_deferred sees that
+  //each collection is filled once.
+  static void tape_acquire(BinaryTape* tape)
+  {
+#ifdef UC_THREADSAFE
+    __atomic_fetch_add(&tape->refcount,1,__ATOMIC_RELAXED);
+#else
+    tape->refcount++;
+#endif
+  }
+
+  static void tape_release(BinaryTape* tape)
+  {
+#ifdef UC_THREADSAFE
+    if (__atomic_sub_fetch(&tape->refcount,1,__ATOMIC_ACQ_REL) == 0)
+      delete tape;
+#else
+    if (--tape->refcount == 0) delete tape;
+#endif
+  }
+
+  /*
+    Decoding that steps over values rather than making them: for a set
+    of paths, or to leave collections to be filled later. Values are
+    stepped over in place, which for a collection written with
+    uc_Binary_Lengths is a single jump. Version 1 blobs have no lengths
+    or varints, and are stepped over by decoding.
+   */
+  class BinaryDecoder {
+  public:
+    BinaryDecoder(Buffer* b, const BinFormat& f) :
+      buffer(b), in(b), format(f), tape(NULL) {}
+
+    //decodes from a tape, deferring every map and array found
+    BinaryDecoder(Buffer* b, BinaryTape* t) :
+      buffer(b), in(b), format(t->format), tape(t) {}
+
+    //the part of the value wanted by node of paths. As with the JSON
+    //decoder, a scalar where the path goes on is not wanted: a map
+    //leaves its key out, and an array keeps a null so the indexes
+    //still line up.
+    void project(UniversalContainer& uc, const UCPathSet& paths, size_t node)
+    {
+      if (paths.whole(node)) {
+	uc = decode_binary(in,false,format);
+	return;
+      }
+      UniversalContainerType type = peek();
+      if (type != uc_Map && type != uc_Array) {
+	skip();
+	return;
+      }
+      buffer->rpos++;
+      size_t end = get_end(in,format);
+      size_t len = get_size(in,format.version);
+      skip_offsets(in,len,format.options);
+      if (type == uc_Map) {
+	uc.init_map();
+	for (size_t j = 0; j < len; j++) {
+	  string key = get_key(in,format);
+	  size_t child = paths.step(node,key);
+	  if (child && (paths.whole(child) || collection())) {
+	    UniversalContainer& slot = element(uc,key);
+	    slot.clear();
+	    project(slot,paths,child);
+	  }
+	  else skip();
+	}
+      }
+      else {
+	uc.init_array();
+	long last = paths.last_index(node);
+	for (size_t j = 0; j < len; j++) {
+	  if ((long) j > last) {
+	    if (end) buffer->rpos = end;
+	    else for (; j < len; j++) skip();
+	    break;
+	  }
+	  size_t child = paths.step(node,(int) j);
+	  UniversalContainer& slot = uc.added_element();
+	  if (child && (paths.whole(child) || collection())) project(slot,paths,child);
+	  else skip();
+	}
+      }
+      check_end(in,end);
+    }
+
+    //a value from the tape, with a collection left to be filled
+    void value(UniversalContainer& uc);
+
+    //fills in the deferred collection whose type byte is at the read
+    //position
+    void fill(UniversalContainer& uc)
+    {
+      UniversalContainerType type;
+      if (!in.fetch(type)) throw ucexception(uce_Deserialization_Error);
+      size_t end = get_end(in,format);
+      size_t len = get_size(in,format.version);
+      skip_offsets(in,len,format.options);
+      for (size_t j = 0; j < len; j++) {
+	if (type == uc_Map) {
+	  UniversalContainer& slot = element(uc,get_key(in,format));
+	  slot.clear();
+	  value(slot);
+	}
+	else value(uc.added_element());
+      }
+      check_end(in,end);
+    }
+
+  private:
+    Buffer* buffer;
+    BinInput in; //reads the same buffer
+    const BinFormat& format;
+    BinaryTape* tape;
+
+    UniversalContainerType peek(void)
+    {
+      if (buffer->rpos >= buffer->length) throw ucexception(uce_Deserialization_Error);
+      return buffer->data[buffer->rpos];
+    }
+
+    bool collection(void)
+    {
+      UniversalContainerType type = peek();
+      return type == uc_Map || type == uc_Array;
+    }
+
+    //a dotted key names a path, as with the brackets operator
+    static UniversalContainer& element(UniversalContainer& uc, const string& key)
+    {
+      return key.find('.') == string::npos ? uc.map_element(key) : uc[key];
+    }
+
+    void skip(void)
+    {
+      if (format.version < 2) {
+	decode_binary(in,false,format);
+	return;
+      }
+      const unsigned char* p = (unsigned char*) buffer->data + buffer->rpos;
+      p = skip_value(p,(unsigned char*) buffer->data + buffer->length,format.options);
+      buffer->rpos = (char*) p - buffer->data;
+    }
+  };
+
+  //fills a collection from the tape when it is first looked at
+  class BinaryDeferred : public UCDeferred {
+  public:
+    BinaryDeferred(BinaryTape* t, size_t a) : tape(t), at(a)
+    {
+      tape_acquire(tape);
+    }
+    ~BinaryDeferred(void) { tape_release(tape); }
+
+    void fill(UniversalContainer& uc)
+    {
+      Buffer buffer(&tape->data[0],tape->data.size());
+      buffer.rpos = at;
+      BinaryDecoder(&buffer,tape).fill(uc);
+    }
+
+  private:
+    BinaryTape* tape;
+    size_t at;
+  };
+
+  void BinaryDecoder::value(UniversalContainer& uc)
+  {
+    if (!collection()) {
+      uc = decode_binary(in,false,format);
+      return;
+    }
+    uc.init_deferred(peek(),new BinaryDeferred(tape,buffer->rpos));
+    skip();
+  }
+
+  UniversalContainer uc_decode_binary(Buffer* buffer, const UCPathSet& paths)
+  {
+    UCDecompressed source(buffer);
+    BinFormat format;
+    UniversalContainer uc;
+    buffer = source.buffer();
+    BinInput in(buffer);
+    get_format(in,format);
+    BinaryDecoder(buffer,format).project(uc,paths,0);
+    return uc;
+  }
+
+  /*
+    The value's bytes are found by stepping over it, and copied to a
+    tape, or a compressed blob is decompressed straight to the tape
+    and read there. Each map or array is left empty until it is looked
+    at, when its own elements are made and any collections among them
+    are deferred in turn.
+   */
+  UniversalContainer uc_decode_binary_lazy(Buffer* buffer)
+  {
+    UniversalContainer uc;
+    BinaryTape* tape = new BinaryTape;
+    try {
+      bool packed = uc_decompress(buffer,tape->data);
+      Buffer whole(tape->data.empty() ? NULL : &tape->data[0],tape->data.size());
+      Buffer* from = packed ? &whole : buffer;
+      BinInput in(from);
+      get_format(in,tape->format);
+      if (tape->format.version < 2) uc = decode_binary(in,false,tape->format);
+      else {
+	const char* start = from->data + from->rpos;
+	const unsigned char* p = (const unsigned char*) start;
+	p = skip_value(p,(unsigned char*) from->data + from->length,tape->format.options);
+	size_t at = 0;
+	if (packed) at = start - from->data;
+	else {
+	  tape->data.assign(start,(const char*) p);
+	  buffer->rpos = (char*) p - buffer->data;
+	}
+	Buffer tape_in(&tape->data[0],tape->data.size());
+	tape_in.rpos = at;
+	BinaryDecoder(&tape_in,tape).value(uc);
+      }
+    }
+    catch (...) {
+      tape_release(tape);
+      throw;
+    }
+    tape_release(tape);
+    return uc;
+  }
+
+  //moves the entries written since start up, to put an offset table
+  //in front of them
+  static void put_offsets(Buffer* buffer, size_t start, const vector<size_t>& offsets)
+  {
+    size_t data = buffer->wpos - start;
+    size_t width = 8;
+    if (data <= 0xFF) width = 1;
+    else if (data <= 0xFFFF) width = 2;
+    else if (data <= 0xFFFFFFFFUL) width = 4;
+    size_t table = 1 + offsets.size() * width;
+    if (!buffer->ensure_space(table)) throw ucexception(uce_Serialization_Error);
+
+    unsigned char* out = (unsigned char*) buffer->data + start;
+    memmove(out + table,out,data);
+    *out++ = (unsigned char) width;
+    for (size_t i = 0; i < offsets.size(); i++)
+      for (size_t k = 0, off = offsets[i]; k < width; k++, off >>= 8)
+	*out++ = (unsigned char) off;
+    buffer->wpos += table;
+    if (buffer->length < buffer->wpos) buffer->length = buffer->wpos;
+  }
+
+  //moves the collection written since start up, to put its length in
+  //front of it
+  static void put_length(Buffer* buffer, size_t start)
+  {
+    unsigned char len[sizeof(size_t) * 8 / 7 + 1];
+    size_t data = buffer->wpos - start;
+    size_t n = 0;
+    for (size_t v = data; v >= 0x80; v >>= 7) len[n++] = (unsigned char) (v | 0x80);
+    len[n] = (unsigned char) (data >> (7 * n));
+    n++;
+    if (!buffer->ensure_space(n)) throw ucexception(uce_Serialization_Error);
+
+    char* out = buffer->data + start;
+    memmove(out + n,out,data);
+    memcpy(out,len,n);
+    buffer->wpos += n;
+    if (buffer->length < buffer->wpos) buffer->length = buffer->wpos;
+  }
+
+  //every distinct map key, each numbered by its place in key order
+  typedef std::map<string,unsigned long> BinKeys;
+
+  //the encoders only read an array's elements, so they walk them
+  //without get_vector or the iterators, which hand the storage out
+  //for writing and leave is_dirty looking inside it from then on
+  class BinaryEncoder {
+  public:
+    static UniversalArray& items(const UniversalContainer& uc)
+    {
+      return uc.array_items();
+    }
+  };
+
+  static void collect_keys(const UniversalContainer& uc, BinKeys& keys)
+  {
+    UniversalArray::iterator viter;
+    UniversalArray::iterator vend;
+    if (uc.get_type() == uc_Map) {
+      std::vector<UniversalMapEntry> entries = uc.sorted_map_entries();
+      for (size_t i = 0; i < entries.size(); i++) {
+	keys.insert(BinKeys::value_type(*entries[i].first,0));
+	collect_keys(*entries[i].second,keys);
+      }
+    }
+    else if (uc.get_type() == uc_Array) {
+      UniversalArray& items = BinaryEncoder::items(uc);
+      vend = items.end();
+      for (viter = items.begin(); viter != vend; viter++)
+	collect_keys(*viter,keys);
+    }
+  }
+
+  static void put_keys(Buffer* buffer, BinKeys& keys, int options)
+  {
+    std::vector<size_t> offsets;
+    unsigned long id = 0;
+    put_varint(buffer,keys.size());
+    size_t start = buffer->wpos;
+    for (BinKeys::iterator i = keys.begin(); i != keys.end(); i++) {
+      if (options & uc_Binary_Offsets) offsets.push_back(buffer->wpos - start);
+      i->second = id++;
+      put_varint(buffer,i->first.length());
+      if (!buffer->put_data(i->first.c_str(),i->first.length()))
+	throw ucexception(uce_Serialization_Error);
+    }
+    if (!offsets.empty()) put_offsets(buffer,start,offsets);
+  }
+
+  static void encode_binary(const UniversalContainer& uc, Buffer* buffer, int options,
+			    const BinKeys& keys)
   {
     UniversalContainerType type = uc.get_type();
     
-    UniversalMap::iterator miter;
-    UniversalMap::iterator mend;
+    std::vector<UniversalMapEntry> entries;
+    std::vector<size_t> offsets;
     UniversalArray::iterator viter;
     UniversalArray::iterator vend;
+    size_t head;
+    size_t start;
     bool tmp;
+    double r = 0;
+    float f = 0;
 
+    if (type == uc_Real) {
+      r = static_cast<double>(uc);
+      f = (float) r;
+      if ((double) f == r) type = bin_Float;
+    }
     if (!buffer->put(type)) throw ucexception(uce_Serialization_Error);
+    head = buffer->wpos;
  
     switch(type) {
     case uc_Integer :
-      if (!buffer->put(static_cast<int>(uc))) 
-	throw ucexception(uce_Serialization_Error);
+      put_varint(buffer,zigzag(static_cast<long>(uc)));
       break;
     case uc_Real :
-      if (!buffer->put(static_cast<double>(uc)))
-	  throw ucexception(uce_Serialization_Error);
+      if (!buffer->put(r)) throw ucexception(uce_Serialization_Error);
+      break;
+    case bin_Float :
+      if (!buffer->put_data((char*) &f,sizeof(f)))
+	throw ucexception(uce_Serialization_Error);
       break;
     case uc_Boolean :
       tmp = uc ? true : false;
@@ -175,44 +793,587 @@ namespace JAD {
 	throw ucexception(uce_Serialization_Error);
       break;
     case uc_String :
-      put_size_field(buffer,uc.length());
-      if (!buffer->put_data(static_cast<string*>(uc)->c_str(),uc.length()))
+      put_varint(buffer,uc.length());
+      if (!buffer->put_data(uc.c_str(),uc.length()))
 	throw ucexception(uce_Serialization_Error);
       break;
-    case uc_WString :
-      put_size_field(buffer,uc.length());
-      if (!buffer->put_data((char*)(static_cast<wstring*>(uc)->c_str()),
-			    uc.length()*sizeof(wchar_t)))
-	throw ucexception(uce_Serialization_Error);
+    case uc_WString : {
+      const wstring& w = *static_cast<wstring*>(uc);
+      put_varint(buffer,w.length());
+      for (size_t i = 0; i < w.length(); i++)
+	put_varint(buffer,(unsigned long) w[i]);
       break;
+    }
     case uc_Null :
       break;
     case uc_Map :
-      put_size_field(buffer,uc.length());
-      mend = uc.map_end();
-      for (miter = uc.map_begin(); miter != mend; miter++) {
-	put_size_field(buffer,miter->first.length());
-	if (!buffer->put_data(miter->first.c_str(),miter->first.length()))
-	  throw ucexception(uce_Serialization_Error);
-	uc_encode_binary(miter->second,buffer);
+      put_varint(buffer,uc.length());
+      entries = uc.sorted_map_entries();
+      start = buffer->wpos;
+      for (size_t i = 0; i < entries.size(); i++) {
+	const string& key = *entries[i].first;
+	if (options & uc_Binary_Offsets) offsets.push_back(buffer->wpos - start);
+	if (options & uc_Binary_Keys) put_varint(buffer,keys.find(key)->second);
+	else {
+	  put_varint(buffer,key.length());
+	  if (!buffer->put_data(key.c_str(),key.length()))
+	    throw ucexception(uce_Serialization_Error);
+	}
+	encode_binary(*entries[i].second,buffer,options,keys);
       }
+      if (!offsets.empty()) put_offsets(buffer,start,offsets);
+      if (options & uc_Binary_Lengths) put_length(buffer,head);
       break;
     case uc_Array :
-      put_size_field(buffer,uc.length());
-      vend = uc.vector_end();
-      for (viter = uc.vector_begin(); viter != vend; viter++) 
-	uc_encode_binary(*viter,buffer);
+      put_varint(buffer,uc.length());
+      start = buffer->wpos;
+      {
+	UniversalArray& items = BinaryEncoder::items(uc);
+	vend = items.end();
+	viter = items.begin();
+      }
+      for (; viter != vend; viter++) {
+	if (options & uc_Binary_Offsets) offsets.push_back(buffer->wpos - start);
+	encode_binary(*viter,buffer,options,keys);
+      }
+      if (!offsets.empty()) put_offsets(buffer,start,offsets);
+      if (options & uc_Binary_Lengths) put_length(buffer,head);
       break;
     case uc_Unknown :
       throw ucexception(uce_Serialization_Error);
     }
   }
+
+  void uc_encode_binary(const UniversalContainer& uc, Buffer* buffer, int options)
+  {
+    BinKeys keys;
+    options &= bin_Options;
+    if (!buffer->put((unsigned char) (bin_Header + uc_Binary_Version)) ||
+	!buffer->put((unsigned char) options))
+      throw ucexception(uce_Serialization_Error);
+    if (options & uc_Binary_Keys) {
+      collect_keys(uc,keys);
+      put_keys(buffer,keys,options);
+    }
+    encode_binary(uc,buffer,options,keys);
+  }
   
-  Buffer* uc_encode_binary(const UniversalContainer& uc)
+  Buffer* uc_encode_binary(const UniversalContainer& uc, int options)
   {
     Buffer* buffer = new Buffer;
-    uc_encode_binary(uc,buffer);
+    uc_encode_binary(uc,buffer,options);
     return buffer;
   }
 
+  /*
+    UCView. Everything is read straight from the encoded bytes, and
+    every read is checked against the end of the blob, so a damaged
+    blob throws uce_Deserialization_Error rather than reading past it.
+  */
+
+  //a map or array, as laid out in the blob
+  struct BinCollection {
+    size_t count;
+    size_t width; //of an offset, or 0 if there is no table
+    const unsigned char* table;
+    const unsigned char* first; //where the first entry starts
+  };
+
+  //a count, then the offset table if there is one
+  static void read_table(const unsigned char* p, const unsigned char* end,
+			 int options, BinCollection& c)
+  {
+    c.count = read_varint(p,end);
+    c.width = 0;
+    if ((options & uc_Binary_Offsets) && c.count) {
+      if (p >= end) throw ucexception(uce_Deserialization_Error);
+      c.width = *p++;
+      if ((c.width != 1 && c.width != 2 && c.width != 4 && c.width != 8) ||
+	  (size_t) (end - p) / c.width < c.count)
+	throw ucexception(uce_Deserialization_Error);
+      c.table = p;
+      p += c.count * c.width;
+    }
+    c.first = p;
+  }
+
+  //the count of a collection, after its length if it has one
+  static const unsigned char* collection_count(const unsigned char* p,
+					       const unsigned char* end, int options)
+  {
+    p++;
+    if (options & uc_Binary_Lengths) read_varint(p,end);
+    return p;
+  }
+
+  static void read_collection(const unsigned char* p, const unsigned char* end,
+			      int options, BinCollection& c)
+  {
+    read_table(collection_count(p,end,options),end,options,c);
+  }
+
+  //the bytes of a string, or of a map key, moving p past them
+  static const unsigned char* read_bytes(const unsigned char*& p,
+					 const unsigned char* end, size_t& len)
+  {
+    len = read_varint(p,end);
+    if (len > (size_t) (end - p)) throw ucexception(uce_Deserialization_Error);
+    const unsigned char* bytes = p;
+    p += len;
+    return bytes;
+  }
+
+  static void skip_key(const unsigned char*& p, const unsigned char* end, int options)
+  {
+    size_t len;
+    if (options & uc_Binary_Keys) read_varint(p,end);
+    else read_bytes(p,end,len);
+  }
+
+  static const unsigned char* skip_entry(const unsigned char* p, const unsigned char* end,
+					 int options, bool map)
+  {
+    if (map) skip_key(p,end,options);
+    return skip_value(p,end,options);
+  }
+
+  //where entry i starts, by the offset table
+  static const unsigned char* table_entry(const BinCollection& c, size_t i,
+					  const unsigned char* end)
+  {
+    const unsigned char* q = c.table + i * c.width;
+    size_t off = 0;
+    for (size_t k = c.width; k--;) off = (off << 8) | q[k];
+    if (off >= (size_t) (end - c.first)) throw ucexception(uce_Deserialization_Error);
+    return c.first + off;
+  }
+
+  //where entry i starts. Without a table, the entries before it are
+  //stepped over.
+  static const unsigned char* entry_at(const BinCollection& c, size_t i,
+				       const unsigned char* end, int options, bool map)
+  {
+    if (c.width) return table_entry(c,i,end);
+    const unsigned char* p = c.first;
+    for (size_t j = 0; j < i; j++) p = skip_entry(p,end,options,map);
+    return p;
+  }
+
+  static const unsigned char* skip_value(const unsigned char* p,
+					 const unsigned char* end, int options)
+  {
+    size_t n;
+    bool map;
+    BinCollection c;
+    if (p >= end) throw ucexception(uce_Deserialization_Error);
+    switch (*p) {
+    case uc_Null :
+      return p + 1;
+    case uc_Integer :
+      p++;
+      read_varint(p,end);
+      return p;
+    case uc_Boolean :
+    case uc_Character :
+      n = 1;
+      break;
+    case uc_Real :
+      n = sizeof(double);
+      break;
+    case bin_Float :
+      n = sizeof(float);
+      break;
+    case uc_String :
+      p++;
+      read_bytes(p,end,n);
+      return p;
+    case uc_WString :
+      p++;
+      n = read_varint(p,end);
+      while (n--) read_varint(p,end);
+      return p;
+    case uc_Map :
+    case uc_Array :
+      if (options & uc_Binary_Lengths) {
+	p++;
+	n = read_varint(p,end);
+	if (n > (size_t) (end - p)) throw ucexception(uce_Deserialization_Error);
+	return p + n;
+      }
+      map = *p == uc_Map;
+      read_collection(p,end,options,c);
+      if (!c.count) return c.first;
+      //only the last entry needs stepping over when there is a table
+      p = entry_at(c,c.count - 1,end,options,map);
+      return skip_entry(p,end,options,map);
+    default :
+      throw ucexception(uce_Deserialization_Error);
+    }
+    if (n >= (size_t) (end - p)) throw ucexception(uce_Deserialization_Error);
+    return p + 1 + n;
+  }
+
+  //where key id starts in the key table at p
+  static const unsigned char* key_at(const unsigned char* p, const unsigned char* end,
+				     int options, unsigned long id)
+  {
+    BinCollection c;
+    size_t len;
+    read_table(p,end,options,c);
+    if (id >= c.count) throw ucexception(uce_Deserialization_Error);
+    if (c.width) return table_entry(c,id,end);
+    p = c.first;
+    for (unsigned long i = 0; i < id; i++) read_bytes(p,end,len);
+    return p;
+  }
+
+  //reads the key table at p into keys, or just steps over it if keys
+  //is NULL, and returns where it ends
+  static const unsigned char* load_keys(const unsigned char* p, const unsigned char* end,
+					int options, vector<string>* keys)
+  {
+    BinCollection c;
+    size_t len;
+    read_table(p,end,options,c);
+    if (!c.count) return c.first;
+    if (!keys && c.width) {
+      p = table_entry(c,c.count - 1,end);
+      read_bytes(p,end,len);
+      return p;
+    }
+    if (keys) keys->resize(c.count);
+    p = c.first;
+    for (size_t i = 0; i < c.count; i++) {
+      const unsigned char* name = read_bytes(p,end,len);
+      if (keys) (*keys)[i].assign((const char*) name,len);
+    }
+    return p;
+  }
+
+  //compares a key in the blob with the one wanted, as std::string would
+  static int compare_key(const unsigned char* p, size_t plen, const char* key, size_t len)
+  {
+    int r = memcmp(p,key,plen < len ? plen : len);
+    if (r) return r;
+    return plen < len ? -1 : plen > len;
+  }
+
+  //finds the index of key in the key table at p
+  static bool key_id(const unsigned char* p, const unsigned char* end, int options,
+		     const char* key, size_t len, unsigned long& id)
+  {
+    BinCollection c;
+    const unsigned char* name;
+    size_t nlen;
+    int r;
+
+    read_table(p,end,options,c);
+    if (c.width) {
+      size_t lo = 0;
+      size_t hi = c.count;
+      while (lo < hi) {
+	size_t mid = lo + (hi - lo) / 2;
+	p = table_entry(c,mid,end);
+	name = read_bytes(p,end,nlen);
+	r = compare_key(name,nlen,key,len);
+	if (!r) {
+	  id = mid;
+	  return true;
+	}
+	if (r < 0) lo = mid + 1;
+	else hi = mid;
+      }
+      return false;
+    }
+    p = c.first;
+    for (size_t i = 0; i < c.count; i++) {
+      name = read_bytes(p,end,nlen);
+      r = compare_key(name,nlen,key,len);
+      if (!r) {
+	id = i;
+	return true;
+      }
+      if (r > 0) break;
+    }
+    return false;
+  }
+
+  //compares the key of the map entry at p with the one wanted, moving
+  //p past it. With a key table, the entry holds an index, and it is
+  //compared with id, the index of the key wanted.
+  static int compare_entry(const unsigned char*& p, const unsigned char* end, int options,
+			   const char* key, size_t len, unsigned long id)
+  {
+    if (options & uc_Binary_Keys) {
+      unsigned long e = read_varint(p,end);
+      return e < id ? -1 : e > id;
+    }
+    size_t nlen;
+    const unsigned char* name = read_bytes(p,end,nlen);
+    return compare_key(name,nlen,key,len);
+  }
+
+  UCView::UCView(void)
+  {
+    at = end = keys = NULL;
+    version = options = 0;
+  }
+
+  UCView::UCView(const Buffer* buffer)
+  {
+    open(buffer->data + buffer->rpos,buffer->length - buffer->rpos);
+  }
+
+  UCView::UCView(const char* data, size_t len)
+  {
+    open(data,len);
+  }
+
+  UCView::UCView(const UCView& parent, const unsigned char* p)
+  {
+    at = p;
+    end = parent.end;
+    keys = parent.keys;
+    version = parent.version;
+    options = parent.options;
+  }
+
+  void UCView::open(const char* data, size_t len)
+  {
+    at = (const unsigned char*) data;
+    end = at + len;
+    read_header(at,end,version,options);
+    keys = NULL;
+    if (options & uc_Binary_Keys) {
+      keys = at;
+      at = load_keys(at,end,options,NULL);
+    }
+    if (version < 2 || at >= end) throw ucexception(uce_Deserialization_Error);
+  }
+
+  bool UCView::exists(void) const
+  {
+    return at != NULL;
+  }
+
+  UniversalContainerType UCView::get_type(void) const
+  {
+    if (!at) return uc_Null;
+    if (*at == bin_Float) return uc_Real;
+    return *at;
+  }
+
+  size_t UCView::size(void) const
+  {
+    return length();
+  }
+
+  size_t UCView::length(void) const
+  {
+    const unsigned char* p;
+    switch (get_type()) {
+    case uc_Map :
+    case uc_Array :
+      p = collection_count(at,end,options);
+      return read_varint(p,end);
+    case uc_String :
+    case uc_WString :
+      p = at + 1;
+      return read_varint(p,end);
+    case uc_Null :
+      return 0;
+    default :
+      throw ucexception(uce_TypeMismatch_Read);
+    }
+  }
+
+  const char* UCView::data(void) const
+  {
+    if (get_type() != uc_String) throw ucexception(uce_TypeMismatch_Read);
+    const unsigned char* p = at + 1;
+    size_t len;
+    return (const char*) read_bytes(p,end,len);
+  }
+
+  const unsigned char* UCView::entry(size_t i) const
+  {
+    BinCollection c;
+    read_collection(at,end,options,c);
+    if (i >= c.count) return NULL;
+    return entry_at(c,i,end,options,*at == uc_Map);
+  }
+
+  UCView UCView::find_key(const char* key, size_t len) const
+  {
+    BinCollection c;
+    unsigned long id = 0;
+    int r;
+
+    if (keys && !key_id(keys,end,options,key,len,id)) return UCView();
+    read_collection(at,end,options,c);
+    const unsigned char* p = c.first;
+    if (c.width) {
+      size_t lo = 0;
+      size_t hi = c.count;
+      while (lo < hi) {
+	size_t mid = lo + (hi - lo) / 2;
+	p = table_entry(c,mid,end);
+	r = compare_entry(p,end,options,key,len,id);
+	if (!r) return UCView(*this,p);
+	if (r < 0) lo = mid + 1;
+	else hi = mid;
+      }
+      return UCView();
+    }
+    //keys are in order, so the search can stop at the first one past
+    for (size_t i = 0; i < c.count; i++) {
+      r = compare_entry(p,end,options,key,len,id);
+      if (!r) return UCView(*this,p);
+      if (r > 0) break;
+      p = skip_value(p,end,options);
+    }
+    return UCView();
+  }
+
+  //one step along a path, following the rules of the brackets
+  //operator
+  UCView UCView::step(const char* key, size_t len) const
+  {
+    UniversalContainerType type = get_type();
+    if (type == uc_Map) return find_key(key,len);
+    if (type != uc_Array || !len) return UCView();
+    size_t i = 0;
+    for (size_t k = 0; k < len; k++) {
+      if (key[k] < '0' || key[k] > '9' || i > (size_t) 0x7FFFFFFF / 10)
+	return UCView();
+      i = i * 10 + (key[k] - '0');
+    }
+    const unsigned char* p = entry(i);
+    return p ? UCView(*this,p) : UCView();
+  }
+
+  UCView UCView::lookup(const char* key, size_t len) const
+  {
+    UCView view = *this;
+    for (;;) {
+      const char* dot = (const char*) memchr(key,'.',len);
+      size_t n = dot ? (size_t) (dot - key) : len;
+      view = view.step(key,n);
+      if (!dot || n + 1 == len) return view;
+      key = dot + 1;
+      len -= n + 1;
+    }
+  }
+
+  UCView UCView::operator[](int i) const
+  {
+    UniversalContainerType type = get_type();
+    if (type == uc_Map) {
+      char key[16];
+      return find_key(key,snprintf(key,sizeof(key),"%d",i));
+    }
+    if (type != uc_Array || i < 0) return UCView();
+    const unsigned char* p = entry(i);
+    return p ? UCView(*this,p) : UCView();
+  }
+
+  UCView UCView::operator[](const std::string& key) const
+  {
+    return lookup(key.data(),key.length());
+  }
+
+  UCView UCView::operator[](const char* key) const
+  {
+    return lookup(key,strlen(key));
+  }
+
+  UCView UCView::operator[](const UCPath& path) const
+  {
+    UCView view = *this;
+    for (size_t i = 0; i < path.segments.size() && view.at; i++) {
+      const UCPath::Segment& seg = path.segments[i];
+      if (view.get_type() == uc_Map)
+	view = view.find_key(seg.key.data(),seg.key.length());
+      else if (seg.numeric) view = view[seg.index];
+      else return UCView();
+    }
+    return view;
+  }
+
+  std::string UCView::key(size_t i) const
+  {
+    if (get_type() != uc_Map) throw ucexception(uce_Non_Map_as_Map);
+    const unsigned char* p = entry(i);
+    if (!p) throw ucexception(uce_Array_Subscript_Out_of_Bounds);
+    if (keys) p = key_at(keys,end,options,read_varint(p,end));
+    size_t len;
+    const unsigned char* name = read_bytes(p,end,len);
+    return string((const char*) name,len);
+  }
+
+  UCView UCView::value(size_t i) const
+  {
+    UniversalContainerType type = get_type();
+    if (type != uc_Map && type != uc_Array) return UCView();
+    const unsigned char* p = entry(i);
+    if (!p) return UCView();
+    if (type == uc_Map) skip_key(p,end,options);
+    return UCView(*this,p);
+  }
+
+  UniversalContainer UCView::decode(void) const
+  {
+    if (!at) return UniversalContainer();
+    BinFormat format;
+    format.version = version;
+    format.options = options;
+    if (keys) load_keys(keys,end,options,&format.keys);
+    Buffer buffer(const_cast<unsigned char*>(at),end - at);
+    BinInput in(&buffer);
+    return decode_binary(in,false,format);
+  }
+
+  UniversalContainer UCView::scalar(void) const
+  {
+    UniversalContainerType type = get_type();
+    if (type == uc_Map || type == uc_Array)
+      throw ucexception(uce_Collection_as_Scalar);
+    return decode();
+  }
+
+  UCView::operator int(void) const
+  {
+    return (int) scalar();
+  }
+
+  UCView::operator long(void) const
+  {
+    return (long) scalar();
+  }
+
+  UCView::operator double(void) const
+  {
+    return (double) scalar();
+  }
+
+  UCView::operator bool(void) const
+  {
+    return (bool) scalar();
+  }
+
+  UCView::operator char(void) const
+  {
+    return (char) scalar();
+  }
+
+  UCView::operator std::string(void) const
+  {
+    return (string) scalar();
+  }
+
+  UCView::operator std::wstring(void) const
+  {
+    return (wstring) scalar();
+  }
+
 } //end namespace
@@ -114,10 +114,8 @@ namespace JAD {
   void uc_encode_ini(const UniversalContainer& uc, Buffer* buffer, 
 		     string prefix, bool form)
   {
-    UniversalMap::iterator miter;
-    UniversalMap::iterator mend;
-    UniversalArray::iterator viter;
-    UniversalArray::iterator vend;
+    std::vector<UniversalMapEntry> entries;
+    UniversalContainer items;
     UniversalContainerType type = uc.get_type();
 
     string pfix;
@@ -129,23 +127,26 @@ namespace JAD {
     case uc_Map :				
       pfix = prefix;
       if (pfix.length() > 0) pfix.push_back('.');
-      mend = uc.map_end();
-      for(miter = uc.map_begin(); miter != mend; miter++) {
-	if (miter->first[0] == '#') continue; //skip metadata
+      entries = uc.sorted_map_entries();
+      for(size_t i = 0; i < entries.size(); i++) {
+	const string& key = *entries[i].first;
+	if (key[0] == '#') continue; //skip metadata
 	tmp = pfix;
-	tmp.append(miter->first);
-	uc_encode_ini(miter->second,buffer,tmp,form);
+	tmp.append(key);
+	uc_encode_ini(*entries[i].second,buffer,tmp,form);
       }
       break;
     case uc_Array :
       pfix = prefix;
       if (pfix.length() > 0) pfix.push_back('.');
-      vend = uc.vector_end();
-      for(viter = uc.vector_begin(); viter != vend; viter++,pos++) {
+      //read by index through a copy sharing the elements, since the
+      //iterators would pin the array for dirty tracking
+      items = uc;
+      for(; pos < (int) items.size(); pos++) {
 	sprintf(buf,"%d",pos);
 	tmp = pfix;
 	tmp.append(buf);
-	uc_encode_ini(*viter,buffer,tmp,form); 
+	uc_encode_ini(items[pos],buffer,tmp,form); 
       }
       break;    
     case uc_Integer :
@@ -311,6 +311,13 @@ typedef unsigned char YY_CHAR;
 #define YY_INTERACTIVE
 
 #include <FlexLexer.h>
+int yyFlexLexer::yylex()
+	{
+	LexerError( "yyFlexLexer::yylex invoked but %option yyclass used" );
+	return 0;
+	}
+
+#define YY_DECL int JAD::JSONLexer::yylex()
 
 int yyFlexLexer::yywrap() { return 1; }
 
@@ -446,7 +453,7 @@ static yyconst flex_int16_t yy_chk[127] =
 #define YY_MORE_ADJ 0
 #define YY_RESTORE_YY_MORE_OFFSET
 #line 1 "json_parser.lex"
-#line 6 "json_parser.lex"
+#line 7 "json_parser.lex"
 /*
  * UniversalContainer library.
  * Copyright Jason Denton, 2008,2010.
@@ -459,6 +466,13 @@ static yyconst flex_int16_t yy_chk[127] =
 #include "ucontainer.h"
 #include "buffer.h"
 #include "ucio.h"
+#include "json_index.h"
+#include "buffer_compress.h"
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
 #define JSON_DECODE_OPEN_MAP 1
 #define JSON_DECODE_CLOSE_MAP 2
 #define JSON_DECODE_OPEN_ARRAY 3
@@ -473,9 +487,32 @@ static yyconst flex_int16_t yy_chk[127] =
 #define JSON_DECODE_ERROR -1
 #define JSON_NO_SYMBOL -2
 
-   static int line_number = 1;
+namespace JAD {
+
+  //the scanner keeps all of its state in the object, so separate
+  //documents can be decoded on separate threads
+  class JSONLexer : public yyFlexLexer
+  {
+    Buffer* buffer;
+    UCFrameReader* frame; //set when the input is compressed
+    size_t consumed; //bytes matched so far
+    size_t token; //where the last token started
+    size_t line;
+    size_t line_start;
+
+    virtual int LexerInput(char*, int);
+  public:
+    JSONLexer(Buffer*, UCFrameReader* = NULL);
+    int yylex(void);
+    char* get_text();
+    UniversalContainer error(void) const;
+  };
 
-#line 479 "ucoder_json.cpp"
+}
+
+#define YY_USER_ACTION token = consumed; consumed += yyleng;
+
+#line 516 "ucoder_json.cpp"
 
 #define INITIAL 0
 
@@ -575,9 +612,9 @@ YY_DECL
 	register char *yy_cp, *yy_bp;
 	register int yy_act;
     
-#line 59 "json_parser.lex"
+#line 90 "json_parser.lex"
 
-#line 581 "ucoder_json.cpp"
+#line 618 "ucoder_json.cpp"
 
 	if ( !(yy_init) )
 		{
@@ -662,76 +699,76 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 60 "json_parser.lex"
+#line 91 "json_parser.lex"
 return JSON_DECODE_OPEN_MAP;
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 61 "json_parser.lex"
+#line 92 "json_parser.lex"
 return JSON_DECODE_CLOSE_MAP;
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 62 "json_parser.lex"
+#line 93 "json_parser.lex"
 return JSON_DECODE_OPEN_ARRAY;
 	YY_BREAK
 case 4:
 YY_RULE_SETUP
-#line 63 "json_parser.lex"
+#line 94 "json_parser.lex"
 return JSON_DECODE_CLOSE_ARRAY;
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
-#line 64 "json_parser.lex"
+#line 95 "json_parser.lex"
 return JSON_DECODE_KVSEP;
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
-#line 65 "json_parser.lex"
+#line 96 "json_parser.lex"
 return JSON_DECODE_STRING;
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 66 "json_parser.lex"
+#line 97 "json_parser.lex"
 return JSON_DECODE_NUMBER;
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 67 "json_parser.lex"
+#line 98 "json_parser.lex"
 return JSON_DECODE_LITERAL;
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 68 "json_parser.lex"
+#line 99 "json_parser.lex"
 return JSON_DECODE_COMMA;
 	YY_BREAK
 case 10:
 /* rule 10 can match eol */
 YY_RULE_SETUP
-#line 69 "json_parser.lex"
-line_number++;
+#line 100 "json_parser.lex"
+{ line++; line_start = consumed; }
 	YY_BREAK
 case YY_STATE_EOF(INITIAL):
-#line 70 "json_parser.lex"
-return JSON_DEOCDE_EOF;
+#line 101 "json_parser.lex"
+{ token = consumed; return JSON_DEOCDE_EOF; }
 	YY_BREAK
 case 11:
 /* rule 11 can match eol */
 YY_RULE_SETUP
-#line 71 "json_parser.lex"
+#line 102 "json_parser.lex"
 //eat whitespace and commas
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 72 "json_parser.lex"
+#line 103 "json_parser.lex"
 return JSON_DECODE_ERROR;
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 73 "json_parser.lex"
+#line 104 "json_parser.lex"
 ECHO;
 	YY_BREAK
-#line 735 "ucoder_json.cpp"
+#line 772 "ucoder_json.cpp"
 
 	case YY_END_OF_BUFFER:
 		{
@@ -1629,29 +1666,24 @@ void yyfree (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 73 "json_parser.lex"
+#line 104 "json_parser.lex"
 
 
 
 namespace JAD {
 
-  class JSONLexer : public yyFlexLexer
-  {
-    Buffer* buffer;
-
-    virtual int LexerInput(char*, int);
-  public:
-    JSONLexer(Buffer*);
-    char* get_text();
-  };
-  
-  JSONLexer::JSONLexer(Buffer* buf) : yyFlexLexer(0,0)
+  JSONLexer::JSONLexer(Buffer* buf, UCFrameReader* f) : yyFlexLexer(0,0)
   {
     buffer = buf;
+    frame = f;
+    consumed = token = line_start = 0;
+    line = 1;
   }
  
+  //compressed input is decompressed as the scanner asks for it
   int JSONLexer::LexerInput(char* data, int max_size)
   {
+    if (frame) return (int) frame->read(data,(size_t) max_size);
     int sent = (int) buffer->copy_out(data,(size_t) max_size);
     return sent;
   }
@@ -1661,66 +1693,101 @@ namespace JAD {
     return yytext;
   }
 
+  //an exception locating the last token, counted from where
+  //decoding began
+  UniversalContainer JSONLexer::error(void) const
+  {
+    UniversalContainer uce = ucexception(uce_Deserialization_Error);
+    json_error_position(uce,token,line,token - line_start + 1);
+    return uce;
+  }
+
+  static int hex_digit(char c)
+  {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+  //the four hex digits after a \u, or -1. Stops at a nul.
+  static long hex_escape(const char* p)
+  {
+    long v = 0;
+    for (int k = 0; k < 4; k++) {
+      int d = hex_digit(p[k]);
+      if (d < 0) return -1;
+      v = (v << 4) | d;
+    }
+    return v;
+  }
+
+  static void put_utf8(string& s, unsigned long c)
+  {
+    if (c < 0x80) s += (char) c;
+    else if (c < 0x800) {
+      s += (char) (0xC0 | (c >> 6));
+      s += (char) (0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000) {
+      s += (char) (0xE0 | (c >> 12));
+      s += (char) (0x80 | ((c >> 6) & 0x3F));
+      s += (char) (0x80 | (c & 0x3F));
+    }
+    else {
+      s += (char) (0xF0 | (c >> 18));
+      s += (char) (0x80 | ((c >> 12) & 0x3F));
+      s += (char) (0x80 | ((c >> 6) & 0x3F));
+      s += (char) (0x80 | (c & 0x3F));
+    }
+  }
+
+  //str points at the opening quote. Runs between escapes are copied
+  //whole, and \u escapes are written out as UTF-8, so the result is
+  //always a narrow string. A surrogate pair becomes one character; half
+  //of a pair on its own becomes U+FFFD.
   UniversalContainer unescape_json_string(char* str)
   {
     UniversalContainer uc;
-    bool need_wstr = false;
     string s;
-    wstring w;
-    size_t i = 1; //skip opening "
-    wchar_t wc;
-
-    while (str[i]) {
-      if (str[i] != '\\') {
-	if (str[i] == '"') break;
-	w.push_back(str[i]);
-	s.push_back(str[i]);
-	i++;
-	continue;
-      }
-      //else char = 
-      i++; 
-      switch(str[i]) {
+    const char* p = str + 1;
+
+    for (;;) {
+      const char* run = p;
+      while (*p && *p != '"' && *p != '\\') p++;
+      s.append(run,p - run);
+      if (*p != '\\') break;
+      p += 2;
+      switch (p[-1]) {
       case '/' :
       case '\\' :
-      case '"' : 
-	w.push_back(str[i]);
-	s.push_back(str[i]);
-	break;
-      case 'n' :
-	w.push_back('\n');
-	s.push_back(str[i]);
-	break;
-      case 't' :
-	w.push_back('\t');
-	s.push_back(str[i]);
-	break;
-      case 'r' :
-	w.push_back('\r');
-	s.push_back(str[i]);
-	break;
-      case 'b' :
-	w.push_back('\b');
-	s.push_back(str[i]);
-	break;
-      case 'f' :
-	w.push_back('\f');
-	s.push_back(str[i]);
-	break;
-      case 'u' :
-	sscanf(str+i+1,"%02X",&wc);
-	w.push_back(wc);
-	need_wstr = true;
-	i += 2;
+      case '"' : s += p[-1]; break;
+      case 'n' : s += '\n'; break;
+      case 't' : s += '\t'; break;
+      case 'r' : s += '\r'; break;
+      case 'b' : s += '\b'; break;
+      case 'f' : s += '\f'; break;
+      case 'u' : {
+	long c = hex_escape(p);
+	if (c < 0) throw ucexception(uce_Deserialization_Error);
+	p += 4;
+	if (c >= 0xD800 && c < 0xDC00 && p[0] == '\\' && p[1] == 'u') {
+	  long low = hex_escape(p + 2);
+	  if (low >= 0xDC00 && low < 0xE000) {
+	    c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+	    p += 6;
+	  }
+	}
+	if (c >= 0xD800 && c < 0xE000) c = 0xFFFD;
+	put_utf8(s,c);
 	break;
       }
-      i++;
-    }
-    if (need_wstr) uc = w;
-    else {
-       if (s.length() == 1) uc = s[0];
-       else uc = s;
+      default :
+	throw ucexception(uce_Deserialization_Error);
+      }
     }
+    if (s.length() == 1) uc = s[0];
+    else uc = s;
     return uc;
   }
   
@@ -1739,12 +1806,12 @@ namespace JAD {
       uc.init_map();
       while (symbol != JSON_DECODE_CLOSE_MAP) {
 	if (symbol != JSON_DECODE_STRING) 
-	  throw ucexception(uce_Deserialization_Error);
+	  throw lex->error();
 	tmp = unescape_json_string(lex->get_text());
 	key = static_cast<string>(tmp);
 	symbol = lex->yylex();
 	if (symbol != JSON_DECODE_KVSEP)
-	  throw ucexception(uce_Deserialization_Error);
+	  throw lex->error();
 	uc[key] = uc_decode_json(lex);
 	symbol = lex->yylex();
 	if (symbol == JSON_DECODE_COMMA)
@@ -1758,7 +1825,7 @@ namespace JAD {
 	uc[idx] = uc_decode_json(lex,symbol);
         symbol = lex->yylex();
         if (symbol == JSON_DECODE_CLOSE_ARRAY) break;
-        if (symbol != JSON_DECODE_COMMA) throw ucexception(uce_Deserialization_Error);
+        if (symbol != JSON_DECODE_COMMA) throw lex->error();
         symbol = JSON_NO_SYMBOL;
 	idx++;
       }
@@ -1773,148 +1840,339 @@ namespace JAD {
       break;
     case JSON_DECODE_ERROR:
     default :
-      UniversalContainer uce = ucexception(uce_Deserialization_Error);
-      uce["input line"] = line_number;
-      throw uce;
+      throw lex->error();
     } //end switch
   }
 
   UniversalContainer uc_decode_json(Buffer* buf)
   {
-    line_number = 0; //lex->lineno appears to be broken, so we have this hack...
-    JSONLexer* jl = new JSONLexer(buf);
-    UniversalContainer uc = uc_decode_json(jl);
-    delete jl;
-    return uc;
+#ifdef UC_JSON_INDEXED
+    return uc_decode_json(buf,uc_JSON_Indexed);
+#else
+    return uc_decode_json(buf,uc_JSON_Lexer);
+#endif
   }
 
-  void escape_char(string& str, char c)
+  UniversalContainer uc_decode_json(Buffer* buf, int engine)
   {
-    if (c == '"') {
-      str.push_back('\\');
-      str.push_back('"');
-    }
-    else if (c == '/') {
-      str.push_back('\\');
-      str.push_back('/');
-    }
-    else if (c == '\n') {
-      str.push_back('\\');
-      str.push_back('n');
-    }     
-    else if (c == '\t') {
-      str.push_back('\\');
-      str.push_back('t');
+    if (engine == uc_JSON_Lazy) return uc_decode_json_lazy(buf);
+    //the lexer reads a compressed document a block at a time. The
+    //index needs the whole text, so gets a decompressed copy.
+    if (uc_is_compressed(buf)) {
+      UCFrameReader frame(buf);
+      if (engine != uc_JSON_Indexed || frame.remaining() > uc_JSON_Index_Limit) {
+	JSONLexer lexer(buf,&frame);
+	UniversalContainer uc = uc_decode_json(&lexer);
+	frame.finish();
+	return uc;
+      }
     }
-    else if (c == '\f') {
-      str.push_back('\\');
-      str.push_back('f');
+    UCDecompressed source(buf);
+    buf = source.buffer();
+    //the index cannot cover more input than its offsets reach, so
+    //larger documents go to the lexer
+    if (engine == uc_JSON_Indexed && buf->length - buf->rpos <= uc_JSON_Index_Limit)
+      return uc_decode_json_indexed(buf);
+
+    JSONLexer lexer(buf);
+    return uc_decode_json(&lexer);
+  }
+
+  /*
+    The encoder writes straight into the buffer. Room for each token
+    is made once, and runs of string bytes that need no escaping are
+    found with json_clean_run and copied whole. Strings are escaped a
+    piece at a time, each piece given room for every byte in it to be
+    escaped, so a long string needs no more than six times a piece of
+    spare room. Given an output, the encoder hands the buffer over
+    whenever the next token would take it past chunk bytes, and the
+    pieces are cut to fit, so the buffer stays about chunk bytes long
+    whatever the document's size.
+   */
+  static const size_t JSON_STRING_PIECE = 64 * 1024;
+
+  class JSONEncoder {
+  public:
+    JSONEncoder(Buffer* b) : buffer(b), output(NULL), chunk(0),
+			     piece(JSON_STRING_PIECE) {}
+    JSONEncoder(Buffer* b, UCOutput* o, size_t c) :
+      buffer(b), output(o), chunk(c), piece((c - 2) / 6) {}
+    void encode(const UniversalContainer&);
+    void flush(void);
+
+  private:
+    Buffer* buffer;
+    UCOutput* output;
+    size_t chunk;
+    size_t piece; //the most string bytes escaped at once
+
+    char* space(size_t need)
+    {
+      if (output && buffer->wpos && buffer->wpos + need > chunk) flush();
+      if (!buffer->ensure_space(need))
+	throw ucexception(uce_Serialization_Error);
+      return buffer->data + buffer->wpos;
     }
-    else if (c == '\r') {
-      str.push_back('\\');
-      str.push_back('r');
+
+    void advance(char* end)
+    {
+      buffer->wpos = end - buffer->data;
+      if (buffer->length < buffer->wpos) buffer->length = buffer->wpos;
     }
-    else if (c == '\b') {
-      str.push_back('\\');
-      str.push_back('b');
+
+    void put(char c)
+    {
+      char* out = space(1);
+      *out++ = c;
+      advance(out);
     }
-    else if (c == '\\') {
-      str.push_back('\\');
-      str.push_back('\\');
+
+    void put_string(const char* str, size_t len);
+    void put_wstring(const wstring& str);
+    void put_integer(long l);
+    void put_real(double d);
+  };
+
+  static char* escape_char(char* out, char c)
+  {
+    switch (c) {
+    case '"' : *out++ = '\\'; *out++ = '"'; break;
+    case '/' : *out++ = '\\'; *out++ = '/'; break;
+    case '\n' : *out++ = '\\'; *out++ = 'n'; break;
+    case '\t' : *out++ = '\\'; *out++ = 't'; break;
+    case '\f' : *out++ = '\\'; *out++ = 'f'; break;
+    case '\r' : *out++ = '\\'; *out++ = 'r'; break;
+    case '\b' : *out++ = '\\'; *out++ = 'b'; break;
+    case '\\' : *out++ = '\\'; *out++ = '\\'; break;
+    default :
+      //other control characters may not appear raw in a string
+      if ((unsigned char) c < 0x20) {
+	static const char hex[] = "0123456789ABCDEF";
+	memcpy(out,"\\u00",4);
+	out[4] = hex[(unsigned char) c >> 4];
+	out[5] = hex[c & 0xF];
+	out += 6;
+      }
+      else *out++ = c;
     }
-    else str.push_back(c);
+    return out;
   }
-  
-  string escape_string(const wstring& orig)
-  {
-    string esc;
-    char buf[8];
 
-    for (size_t i = 0; i < orig.length(); i++) {
-      if (orig[i] > 255) {
-	sprintf(buf,"\\u%04X",(int)orig[i]);
-	esc.append(buf);
+  void JSONEncoder::put_string(const char* str, size_t len)
+  {
+    //an escaped byte takes up to 6
+    size_t n = len < piece ? len : piece;
+    char* out = space(6 * n + 2);
+    *out++ = '"';
+    for (;;) {
+      len -= n;
+      while (n) {
+	size_t run = json_clean_run(str,n);
+	memcpy(out,str,run);
+	out += run;
+	str += run;
+	n -= run;
+	if (!n) break;
+	out = escape_char(out,*str++);
+	n--;
       }
-      else escape_char(esc,static_cast<char>(orig[i]));
+      if (!len) break;
+      advance(out);
+      n = len < piece ? len : piece;
+      out = space(6 * n + 1);
     }
-    return esc;
+    *out++ = '"';
+    advance(out);
   }
 
-  string escape_string(const string& orig)
+  void JSONEncoder::put_wstring(const wstring& str)
   {
-    string esc;
+    //a surrogate pair of \u escapes for each character, and a nul
+    size_t step = piece / 8;
+    char* out = space(1);
+    *out++ = '"';
+    advance(out);
+    for (size_t i = 0; i < str.length();) {
+      size_t end = str.length() - i < step ? str.length() : i + step;
+      out = space(12 * (end - i) + 1);
+      for (; i < end; i++) {
+	unsigned long c = str[i];
+	if (c < 0x80) out = escape_char(out,static_cast<char>(c));
+	else if (c < 0x10000) out += sprintf(out,"\\u%04lX",c);
+	else if (c < 0x110000) {
+	  c -= 0x10000;
+	  out += sprintf(out,"\\u%04lX\\u%04lX",0xD800 + (c >> 10),0xDC00 + (c & 0x3FF));
+	}
+	else out += sprintf(out,"\\uFFFD");
+      }
+      advance(out);
+    }
+    put('"');
+  }
 
-    for (size_t i = 0; i < orig.length(); i++) 
-      escape_char(esc,static_cast<char>(orig[i]));
-    
-    return esc;
+  void JSONEncoder::put_integer(long l)
+  {
+    char digits[24];
+    char* p = digits + sizeof(digits);
+    //work in the negative range, which also holds the smallest long
+    long n = l < 0 ? l : -l;
+    do {
+      *--p = '0' - (char)(n % 10);
+      n /= 10;
+    } while (n);
+    if (l < 0) *--p = '-';
+    size_t len = digits + sizeof(digits) - p;
+    char* out = space(len);
+    memcpy(out,p,len);
+    advance(out + len);
   }
 
-  void uc_encode_json(const UniversalContainer& uc, Buffer* buffer)
+  //the shortest text that reads back as the same double. NaN and the
+  //infinities have no JSON form, and throw uce_Serialization_Error.
+  void JSONEncoder::put_real(double d)
   {
-    UniversalMap::iterator miter;
-    UniversalMap::iterator mend;
-    UniversalArray::iterator viter;
-    UniversalArray::iterator vend;
+    if (!(d - d == 0)) throw ucexception(uce_Serialization_Error);
+    char* out = space(32);
+#ifdef __cpp_lib_to_chars
+    advance(std::to_chars(out,out + 32,d).ptr);
+#else
+    int len = snprintf(out,32,"%.15g",d);
+    if (strtod(out,NULL) != d) len = snprintf(out,32,"%.16g",d);
+    if (strtod(out,NULL) != d) len = snprintf(out,32,"%.17g",d);
+    advance(out + len);
+#endif
+  }
 
+  void JSONEncoder::encode(const UniversalContainer& uc)
+  {
+    std::vector<UniversalMapEntry> entries;
     bool first_pass = false;
-    string tmp;
-    UniversalContainerType type = uc.get_type();
 
-    switch(type) {
+    switch(uc.type) {
     case uc_Map :
-      buffer->put('{');
-      mend = uc.map_end();
-      for(miter = uc.map_begin(); miter != mend; miter++) {
-	if (miter->first[0] == '#') continue; //skip metadata
-	if (first_pass) buffer->put(',');
-	buffer->put('"');
-	tmp = escape_string(miter->first);
-	buffer->put_data(tmp.c_str(),tmp.length());
-	buffer->put('"');
-	buffer->put(':');
-	uc_encode_json(miter->second,buffer);
+      put('{');
+      entries = uc.sorted_map_entries();
+      for(size_t i = 0; i < entries.size(); i++) {
+	const string& key = *entries[i].first;
+	if (key[0] == '#') continue; //skip metadata
+	if (first_pass) put(',');
+	put_string(key.data(),key.length());
+	put(':');
+	encode(*entries[i].second);
 	first_pass = true;
       }
-      buffer->put('}');
+      put('}');
       break;
-    case uc_Array :
-      buffer->put('[');
-      vend = uc.vector_end();
-      for(viter = uc.vector_begin(); viter != vend; viter++) {
-	if (first_pass) buffer->put(',');
-	uc_encode_json(*viter,buffer);
-	first_pass = true;
+    case uc_Array : {
+      UniversalArray& items = uc.array_items();
+      put('[');
+      for(size_t i = 0; i < items.size(); i++) {
+	if (i) put(',');
+	encode(items[i]);
       }
-      buffer->put(']');
-      break;    
+      put(']');
+      break;
+    }
     case uc_String :
-      buffer->put('"');
-      tmp = escape_string(static_cast<string>(uc));
-      buffer->put_data(tmp.c_str(),tmp.length());
-      buffer->put('"');
+      put_string(uc.c_str(),uc.length());
       break;
     case uc_WString :
-      buffer->put('"');
-      tmp = escape_string(static_cast<wstring>(uc));
-      buffer->put_data(tmp.c_str(),tmp.length());
-      buffer->put('"');
+      put_wstring(uc.data.wstr->value);
       break;
     case uc_Character :
-      buffer->put('"');
-      buffer->put(static_cast<char>(uc));
-      buffer->put('"');
+      put_string(&uc.data.chr,1);
       break;
-    default :      
-      tmp = static_cast<string>(uc);
-      buffer->put_data(tmp.c_str(),tmp.length());
+    case uc_Integer :
+      put_integer(uc.data.num);
+      break;
+    case uc_Real :
+      put_real(uc.data.real);
+      break;
+    case uc_Boolean :
+      if (uc.data.tf) {
+	memcpy(space(4),"true",4);
+	advance(buffer->data + buffer->wpos + 4);
+      }
+      else {
+	memcpy(space(5),"false",5);
+	advance(buffer->data + buffer->wpos + 5);
+      }
+      break;
+    case uc_Null :
+      memcpy(space(4),"null",4);
+      advance(buffer->data + buffer->wpos + 4);
+      break;
+    default :
+      throw ucexception(uce_Serialization_Error);
     } //end type switch
   }
 
+  //hands what is in the buffer to the output, and empties it
+  void JSONEncoder::flush(void)
+  {
+    if (buffer->wpos) output->write(buffer->data,buffer->wpos);
+    buffer->clear();
+  }
+
+  void uc_encode_json(const UniversalContainer& uc, Buffer* buffer)
+  {
+    JSONEncoder encoder(buffer);
+    encoder.encode(uc);
+  }
+
+  void uc_encode_json(const UniversalContainer& uc, UCOutput& output, size_t chunk)
+  {
+    if (chunk < 64) chunk = 64; //room for any number
+    Buffer buffer(chunk);
+    JSONEncoder encoder(&buffer,&output,chunk);
+    encoder.encode(uc);
+    encoder.flush();
+  }
+
+  //an output for each of the targets write_from_buffer knows
+  template <typename T>
+  class JSONStreamOutput : public UCOutput {
+  public:
+    JSONStreamOutput(T o) : out(o) {}
+    void write(const char* data, size_t len)
+    {
+      Buffer piece(const_cast<char*>(data),len);
+      if (!write_from_buffer(&piece,out))
+	throw ucexception(uce_Serialization_Error);
+    }
+
+  private:
+    T out;
+  };
+
+  void uc_encode_json(const UniversalContainer& uc, int fd, size_t chunk)
+  {
+    JSONStreamOutput<int> output(fd);
+    uc_encode_json(uc,output,chunk);
+  }
+
+  void uc_encode_json(const UniversalContainer& uc, FILE* file, size_t chunk)
+  {
+    JSONStreamOutput<FILE*> output(file);
+    uc_encode_json(uc,output,chunk);
+  }
+
+  void uc_encode_json(const UniversalContainer& uc, ostream& out, size_t chunk)
+  {
+    JSONStreamOutput<ostream&> output(out);
+    uc_encode_json(uc,output,chunk);
+  }
+
   Buffer* uc_encode_json(const UniversalContainer& uc)
   {
     Buffer* buffer = new Buffer;
-    uc_encode_json(uc, buffer);
+    try {
+      uc_encode_json(uc, buffer);
+    }
+    catch (...) {
+      delete buffer;
+      throw;
+    }
     buffer->rewind();
     return buffer;
   }
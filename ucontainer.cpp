@@ -14,8 +14,11 @@
 #include <cstdlib>
 #include <cstdio>
 #include <limits>
+#include <algorithm>
+#include <stdint.h>
 #include "ucontainer.h"
 #include "stl_util.h"
+#include <sched.h>
 
 /*
   Limitations :
@@ -44,6 +47,582 @@ namespace JAD {
   static const char* true_str = "true";
   static const char* false_str = "false";
 
+  //inline_room values marking a string held on the heap, or in
+  //memory the container does not own, an arena or a borrowed buffer.
+  //Span strings are never freed, so are copied by value.
+  static const unsigned char HEAP_STRING = 0xFF;
+  static const unsigned char SPAN_STRING = 0xFE;
+
+  typedef std::vector<std::pair<std::string,UniversalContainer>,
+		      UC_ALLOCATOR<std::pair<std::string,UniversalContainer> > > UniversalFlatMap;
+
+  /*
+    Dirty tracking state. Every element of a map or array knows, through
+    home, the collection it is in, as an index into the tracking table
+    below. When a clean element is made dirty, its home counts it, and a
+    collection with a count is active. A collection turning active is
+    counted in turn by every collection holding it, found through its
+    owners, so a change is carried to the top as it is made, and
+    is_dirty only looks at a flag and a count. clean goes down only into
+    what is dirty or active, and takes the counts back on the way.
+
+    A container outside any collection, such as a copy or a local, has
+    no home. Copies start with none, and assignment keeps the home of
+    the container assigned to, so a reference into a collection stays
+    tracked whatever is written through it. Collections stamp elements
+    with their home as they are added, and again after anything that
+    may have moved them.
+
+    Storage handed out through get_map, get_vector or the iterators can
+    be changed without the collection knowing. Such a collection is
+    pinned, and is_dirty and clean look inside it, and inside every
+    collection holding it, from then on.
+   */
+  struct UCTracking {
+    unsigned index; //place in the tracking table, 0 until needed
+    unsigned count; //dirty elements, active collections held, changed
+    unsigned owner; //home of a container holding this, or 0
+    std::vector<unsigned>* owners; //homes of any more holders
+    bool changed; //keys removed since the last clean
+    bool pinned;
+    bool pinned_below; //this, or something in it, is pinned
+    bool fill_clean; //cleaned before it was filled, see fill_deferred
+#ifdef UC_ARENA
+    UCArena* arena; //the arena the storage is in, current as new_shared makes it
+#endif
+
+    UCTracking(void) : index(0), count(0), owner(0), owners(NULL),
+		       changed(false), pinned(false), pinned_below(false),
+		       fill_clean(false)
+#ifdef UC_ARENA
+		     , arena(UCArena::current())
+#endif
+    {}
+    ~UCTracking(void);
+
+  private:
+    UCTracking(const UCTracking&);
+    void operator=(const UCTracking&);
+  };
+
+  /*
+    Storage behind a map container. Small maps keep their entries in
+    flat, sorted by key and searched linearly. Once a map grows past
+    uc_Flat_Map_Limit keys, or a caller asks for the UniversalMap
+    itself, the entries move to tree and stay there. Both live in the
+    shared block, so every container sharing the map sees the move.
+   */
+  struct UCMapStorage : UCTracking {
+    UniversalFlatMap flat;
+    UniversalMap* tree;
+    UCDeferred* deferred; //set until the entries are made
+
+    UCMapStorage(void) : tree(NULL), deferred(NULL) {}
+    ~UCMapStorage(void);
+
+  private:
+    UCMapStorage(const UCMapStorage&);
+    void operator=(const UCMapStorage&);
+  };
+
+  struct UCArrayStorage : UCTracking {
+    UniversalArray items;
+    UCDeferred* deferred; //set until the items are made
+
+    UCArrayStorage(void) : deferred(NULL) {}
+    ~UCArrayStorage(void) { delete deferred; }
+
+  private:
+    UCArrayStorage(const UCArrayStorage&);
+    void operator=(const UCArrayStorage&);
+  };
+
+  //the map's tree, or NULL while it is flat. When built with
+  //UC_THREADSAFE the tree may be published by a reader on another
+  //thread, so it is loaded with acquire ordering.
+  static inline UniversalMap* tree_of(const UCMapStorage& m)
+  {
+#ifdef UC_THREADSAFE
+    return __atomic_load_n(&m.tree,__ATOMIC_ACQUIRE);
+#else
+    return m.tree;
+#endif
+  }
+
+  //position of key in a flat map, or where it belongs if absent
+  static UniversalFlatMap::iterator flat_position(UniversalFlatMap& flat,
+						  const string& key)
+  {
+    UniversalFlatMap::iterator i = flat.begin();
+    UniversalFlatMap::iterator end = flat.end();
+    while (i != end && i->first < key) i++;
+    return i;
+  }
+
+  //true while an arena scope is active on this thread
+  static inline bool arena_scope_active(void)
+  {
+#ifdef UC_ARENA
+    return UCArena::current() != NULL;
+#else
+    return false;
+#endif
+  }
+
+  //shared blocks come from arena, or the heap given NULL. The block's
+  //collections are made with arena current, so they grow into the same
+  //place whatever scope is active later.
+#ifdef UC_ARENA
+  template <typename T>
+  static UCShared<T>* new_shared(UCArena* arena)
+  {
+    UCArenaScope scope(arena);
+    if (arena) {
+      UCShared<T>* s = new(arena->allocate(sizeof(UCShared<T>))) UCShared<T>;
+      s->in_arena = true;
+      return s;
+    }
+    return new UCShared<T>;
+  }
+#else
+  template <typename T>
+  static UCShared<T>* new_shared(UCArena*)
+  {
+    return new UCShared<T>;
+  }
+#endif
+
+  template <typename T>
+  static void delete_shared(UCShared<T>* s)
+  {
+    if (s->in_arena) s->~UCShared<T>();
+    else delete s;
+  }
+
+  //a map or array in an arena that refers to nothing outside it is
+  //left as it is, elements and all. The arena hands back the memory,
+  //and the tracking index, when it goes.
+  template <typename T>
+  static void delete_collection(UCShared<T>* s)
+  {
+#ifdef UC_ARENA
+    if (s->in_arena && !s->value.arena->has_external()) return;
+#endif
+    delete_shared(s);
+  }
+
+  //a map's tree goes in the arena its storage is in
+#ifdef UC_ARENA
+  static UniversalMap* new_tree(const UCMapStorage& m)
+  {
+    UCArenaScope scope(m.arena);
+    if (m.arena) return new(m.arena->allocate(sizeof(UniversalMap))) UniversalMap;
+    return new UniversalMap;
+  }
+
+  static void delete_tree(const UCMapStorage& m, UniversalMap* tree)
+  {
+    if (!m.arena) delete tree;
+    else if (tree) tree->~UniversalMap();
+  }
+#else
+  static UniversalMap* new_tree(const UCMapStorage&)
+  {
+    return new UniversalMap;
+  }
+
+  static void delete_tree(const UCMapStorage&, UniversalMap* tree)
+  {
+    delete tree;
+  }
+#endif
+
+  UCMapStorage::~UCMapStorage(void)
+  {
+    delete_tree(*this,tree);
+    delete deferred;
+  }
+
+  /*
+    Reference count updates. When built with UC_THREADSAFE these are
+    atomic, so copies of a container sharing one payload may be handed
+    to and destroyed by different threads. Taking a reference needs no
+    ordering, since the caller already holds one. Dropping a reference
+    must publish our writes to whichever thread ends up deleting the
+    payload, and that thread must see them before it deletes.
+   */
+#ifdef UC_THREADSAFE
+  static inline void ref_acquire(unsigned& count)
+  {
+    __atomic_fetch_add(&count,1,__ATOMIC_RELAXED);
+  }
+
+  static inline bool ref_drop(unsigned& count)
+  {
+    return __atomic_sub_fetch(&count,1,__ATOMIC_ACQ_REL) == 0;
+  }
+
+  static inline bool ref_unique(const unsigned& count)
+  {
+    return __atomic_load_n(&count,__ATOMIC_ACQUIRE) == 1;
+  }
+#else
+  static inline void ref_acquire(unsigned& count)
+  {
+    count++;
+  }
+
+  static inline bool ref_drop(unsigned& count)
+  {
+    return --count == 0;
+  }
+
+  static inline bool ref_unique(const unsigned& count)
+  {
+    return count == 1;
+  }
+#endif
+
+  /*
+    The tracking table. An element's home is an index into it, naming
+    the collection the element is in. The table grows in chunks that
+    are never moved or freed, chunk k holding TRACK_CHUNK << k entries,
+    so reading an entry never races with growth. A free entry holds the
+    next free index, shifted up and tagged with the low bit. Separate
+    documents may be built on separate threads in any build, as
+    uc_decode_json_lines does, so indices are handed out and taken back
+    under table_busy.
+
+    Under UC_THREADSAFE copies of one collection may be written and
+    destroyed by different threads, so the counts and the owner lists
+    are changed under track_busy as well. is_dirty reads the counts and
+    flags without it.
+   */
+  static const int TRACK_CHUNK_BITS = 10;
+  static const unsigned TRACK_CHUNK = 1U << TRACK_CHUNK_BITS;
+  static const int TRACK_CHUNKS = 20; //as far as a 30 bit home reaches
+  static const unsigned TRACK_LAST = (TRACK_CHUNK << TRACK_CHUNKS) - TRACK_CHUNK;
+
+  static UCTracking** track_chunks[TRACK_CHUNKS];
+  static unsigned track_used = 0; //indices handed out so far
+  static unsigned track_free = 0; //first free index, or 0
+
+  //holds a lock made of one flag, for short stretches of work
+  struct UCSpinLock {
+    char& busy;
+
+    UCSpinLock(char& b) : busy(b)
+    {
+      while (__atomic_test_and_set(&busy,__ATOMIC_ACQUIRE))
+	sched_yield();
+    }
+
+    ~UCSpinLock(void) { __atomic_clear(&busy,__ATOMIC_RELEASE); }
+  };
+
+  static char table_busy;
+
+#ifdef UC_THREADSAFE
+  static char track_busy;
+
+  struct UCTrackLock : UCSpinLock {
+    UCTrackLock(void) : UCSpinLock(track_busy) {}
+  };
+
+  static inline bool flag_get(const bool& f)
+  {
+    return __atomic_load_n(&f,__ATOMIC_RELAXED);
+  }
+
+  static inline void flag_set(bool& f, bool v)
+  {
+    __atomic_store_n(&f,v,__ATOMIC_RELAXED);
+  }
+
+  static inline unsigned count_get(const unsigned& c)
+  {
+    return __atomic_load_n(&c,__ATOMIC_RELAXED);
+  }
+
+  static inline void count_set(unsigned& c, unsigned v)
+  {
+    __atomic_store_n(&c,v,__ATOMIC_RELAXED);
+  }
+#else
+  struct UCTrackLock {
+    UCTrackLock(void) {}
+    ~UCTrackLock(void) {}
+  };
+
+  static inline bool flag_get(const bool& f)
+  {
+    return f;
+  }
+
+  static inline void flag_set(bool& f, bool v)
+  {
+    f = v;
+  }
+
+  static inline unsigned count_get(const unsigned& c)
+  {
+    return c;
+  }
+
+  static inline void count_set(unsigned& c, unsigned v)
+  {
+    c = v;
+  }
+#endif
+
+  static UCTracking*& track_slot(unsigned index)
+  {
+    unsigned p = index - 1 + TRACK_CHUNK;
+    int k = 31 - __builtin_clz(p) - TRACK_CHUNK_BITS;
+    UCTracking** chunk = __atomic_load_n(&track_chunks[k],__ATOMIC_ACQUIRE);
+    return chunk[p - (TRACK_CHUNK << k)];
+  }
+
+  //a new index for t, or 0 once the table is full
+  static unsigned track_add(UCTracking* t)
+  {
+    UCSpinLock lock(table_busy);
+    unsigned index = track_free;
+    if (index) {
+      UCTracking*& slot = track_slot(index);
+      track_free = (unsigned) (reinterpret_cast<uintptr_t>(slot) >> 1);
+      slot = t;
+      return index;
+    }
+    if (track_used == TRACK_LAST) return 0;
+    index = track_used + 1;
+    unsigned p = index - 1 + TRACK_CHUNK;
+    int k = 31 - __builtin_clz(p) - TRACK_CHUNK_BITS;
+    if (!track_chunks[k])
+      __atomic_store_n(&track_chunks[k],new UCTracking*[TRACK_CHUNK << k],
+		       __ATOMIC_RELEASE);
+    track_used = index;
+    track_slot(index) = t;
+    return index;
+  }
+
+  static void track_remove(const unsigned* index, unsigned n)
+  {
+    UCSpinLock lock(table_busy);
+    for (unsigned i = 0; i < n; i++) {
+      track_slot(index[i]) = reinterpret_cast<UCTracking*>(((uintptr_t) track_free << 1) | 1);
+      track_free = index[i];
+    }
+  }
+
+  //the rest expect track_busy to be held, under UC_THREADSAFE
+
+  static void pin_up(UCTracking* t);
+
+  static void count_up(unsigned home)
+  {
+    UCTracking* t = track_slot(home);
+    count_set(t->count,t->count + 1);
+    if (t->count > 1) return;
+    if (t->owner) count_up(t->owner);
+    if (t->owners)
+      for (size_t i = 0; i < t->owners->size(); i++) count_up((*t->owners)[i]);
+  }
+
+  static void count_down(unsigned home)
+  {
+    UCTracking* t = track_slot(home);
+    count_set(t->count,t->count - 1);
+    if (t->count) return;
+    if (t->owner) count_down(t->owner);
+    if (t->owners)
+      for (size_t i = 0; i < t->owners->size(); i++) count_down((*t->owners)[i]);
+  }
+
+  //a container at home now holds t
+  static void add_owner(UCTracking* t, unsigned home)
+  {
+    if (!t->owner) t->owner = home;
+    else {
+      if (!t->owners) {
+	t->owners = new std::vector<unsigned>;
+#ifdef UC_ARENA
+	if (t->arena) t->arena->add_external();
+#endif
+      }
+      t->owners->push_back(home);
+    }
+    if (t->count) count_up(home);
+    if (t->pinned_below) pin_up(track_slot(home));
+  }
+
+  static void drop_owner(UCTracking* t, unsigned home)
+  {
+    if (t->owner == home) t->owner = 0;
+    else {
+      std::vector<unsigned>::iterator i = std::find(t->owners->begin(),
+						    t->owners->end(),home);
+      if (i == t->owners->end()) return;
+      *i = t->owners->back();
+      t->owners->pop_back();
+    }
+    if (t->count) count_down(home);
+  }
+
+  static void pin_up(UCTracking* t)
+  {
+    if (t->pinned_below) return;
+    flag_set(t->pinned_below,true);
+    if (t->owner) pin_up(track_slot(t->owner));
+    if (t->owners)
+      for (size_t i = 0; i < t->owners->size(); i++)
+	pin_up(track_slot((*t->owners)[i]));
+  }
+
+  static void pin(UCTracking* t)
+  {
+    flag_set(t->pinned,true);
+    pin_up(t);
+  }
+
+  static void release_index(unsigned index)
+  {
+    UCTrackLock lock;
+    track_remove(&index,1);
+  }
+
+#ifdef UC_ARENA
+  //the indices of collections in an arena, given back together
+  struct UCArenaIndices {
+    static const unsigned SIZE = 1024;
+    unsigned count;
+    unsigned index[SIZE];
+  };
+
+  static void release_arena_indices(void* p)
+  {
+    UCArenaIndices* list = static_cast<UCArenaIndices*>(p);
+    UCTrackLock lock;
+    track_remove(list->index,list->count);
+  }
+
+  static void arena_index(UCArena* arena, unsigned index)
+  {
+    UCArenaIndices* list =
+      static_cast<UCArenaIndices*>(arena->last_release(release_arena_indices));
+    if (!list || list->count == UCArenaIndices::SIZE) {
+      list = static_cast<UCArenaIndices*>(arena->allocate(sizeof(UCArenaIndices)));
+      list->count = 0;
+      arena->at_release(release_arena_indices,list);
+    }
+    list->index[list->count++] = index;
+  }
+#endif
+
+  //t's index, made the first time one is needed. Once the table is
+  //full a collection is pinned instead, and is_dirty looks inside it.
+  //A collection in an arena may be freed without being destroyed, so
+  //its arena gives the index back.
+  static unsigned index_of(UCTracking* t)
+  {
+    if (!t->index) {
+      t->index = track_add(t);
+      if (!t->index) pin(t);
+#ifdef UC_ARENA
+      else if (t->arena) arena_index(t->arena,t->index);
+#endif
+    }
+    return t->index;
+  }
+
+  UCTracking::~UCTracking(void)
+  {
+#ifdef UC_ARENA
+    if (arena) index = 0; //given back by the arena
+#endif
+    if (index) release_index(index);
+    delete owners;
+  }
+
+  //for get_map, get_vector and the iterators, which hand out storage
+  //that can be changed without the collection knowing
+  static void expose(UCTracking* t)
+  {
+    if (flag_get(t->pinned)) return;
+#ifdef UC_ARENA
+    //anything at all may be put in it now
+    if (t->arena) t->arena->add_external();
+#endif
+    UCTrackLock lock;
+    pin(t);
+  }
+
+  //a new container is dirty, and in no collection
+  void UniversalContainer::init_flags(void)
+  {
+    home = 0;
+    in_scope = arena_scope_active();
+    dirty = true;
+  }
+
+  //marks a change, and has the collection holding this count it
+  void UniversalContainer::set_dirty(void)
+  {
+    if (dirty) return;
+    dirty = true;
+    if (home) {
+      UCTrackLock lock;
+      count_up(home);
+    }
+  }
+
+  /*
+    The arena for a container's long strings, maps and arrays. An
+    element uses the arena of the collection holding it, whatever scope
+    is active when it is written. A container in no collection uses the
+    current arena only if it was made inside a scope, so a long lived
+    document written to inside a scope keeps its values on the heap, and
+    never points into an arena that goes away before it.
+   */
+#ifdef UC_ARENA
+  UCArena* UniversalContainer::value_arena(void) const
+  {
+    if (home) return track_slot(home)->arena;
+    return in_scope ? UCArena::current() : NULL;
+  }
+
+  //an element in an arena that now holds memory from outside it, on
+  //the heap or in another arena, keeps the arena from freeing its
+  //collections without destroying them
+  void UniversalContainer::note_external(void) const
+  {
+    if (!home || !shared()) return;
+    UCArena* arena = track_slot(home)->arena;
+    if (!arena || arena->has_external()) return;
+    UCTracking* t = tracking();
+    if (!t || t->arena != arena) arena->add_external();
+  }
+
+  //a key too long for the string itself is kept on the heap
+  static inline void note_key(UCMapStorage& m, const string& key)
+  {
+    if (m.arena && key.length() > string().capacity()) m.arena->add_external();
+  }
+#else
+  UCArena* UniversalContainer::value_arena(void) const
+  {
+    return NULL;
+  }
+
+  void UniversalContainer::note_external(void) const
+  {
+  }
+
+  static inline void note_key(UCMapStorage&, const string&)
+  {
+  }
+#endif
+
   /*
     The set routines are mostly called by the assignment operators
     to do the acutal work of setting a particular type and value into
@@ -54,74 +633,158 @@ namespace JAD {
   {
     type = uc_Integer;
     data.num = l;
-    dirty = true;
+    set_dirty();
   }
 
   void UniversalContainer::set_value_char(char c)
   {
     type = uc_Character;
     data.chr = c;
-    dirty = true;
+    set_dirty();
   }
 
   void UniversalContainer::set_value_double(double d)
   {
     type = uc_Real;
     data.real = d;
-    dirty = true;
+    set_dirty();
   }
 
   void UniversalContainer::set_value_bool(bool b)
   {
     type = uc_Boolean;
     data.tf = b;
-    dirty = true;
+    set_dirty();
   }
 
   void UniversalContainer::set_value_string(const string& s)
   {
-    //if we already have a string reference
-    if (refcount) {
-      if (*refcount > 1) { //someone else point at this string;
-	(*refcount)--;
-	refcount = new unsigned;
-	(*refcount) = 1;
-      }
-      else if (*refcount == 1)
-	delete data.str;
-      //else we are in trouble
+    //a long string we hold alone can be overwritten in place
+    if (type == uc_String && inline_room == HEAP_STRING &&
+	ref_unique(data.str->refcount) && s.length() > uc_Inline_Length) {
+      data.str->value = s;
+      set_dirty();
+      return;
     }
-    else { //starting fresh
-      refcount = new unsigned;
-      *refcount = 1;
+
+    //park the old contents until we are done, s may refer to them
+    UniversalContainer old;
+    swap_contents(old);
+
+    //short strings are copied into the container itself
+    if (s.length() <= uc_Inline_Length) {
+      memcpy(chars,s.data(),s.length());
+      chars[s.length()] = '\0';
+      inline_room = uc_Inline_Length - s.length();
+    }
+#ifdef UC_ARENA
+    else if (value_arena() && s.length() == (unsigned short) s.length()) {
+      char* copy = static_cast<char*>(value_arena()->allocate(s.length() + 1));
+      memcpy(copy,s.c_str(),s.length() + 1);
+      data.span = copy;
+      span_length = s.length();
+      inline_room = SPAN_STRING;
+    }
+#endif
+    else {
+      data.str = new UCShared<string>(s);
+      inline_room = HEAP_STRING;
     }
-    
     type = uc_String;
-    dirty = true;
-    data.str = new string(s);
+    set_dirty();
+    note_external();
   }
 
-  void UniversalContainer::set_value_wstring(const wstring& s)
+#ifdef UC_MOVE_SEMANTICS
+  //takes over the characters of a long string rather than copying them
+  void UniversalContainer::set_value_string(string&& s)
   {
-    //if we already have a string reference
-    if (refcount) {
-      if (*refcount > 1) { //someone else point at this string;
-	(*refcount)--;
-	refcount = new unsigned;
-	(*refcount) = 1;
-      }
-      else if (*refcount == 1)
-	delete data.wstr;
-      //else we are in trouble
+#ifdef UC_ARENA
+    if (value_arena()) {
+      set_value_string(static_cast<const string&>(s));
+      return;
+    }
+#endif
+    if (s.length() <= uc_Inline_Length) {
+      set_value_string(static_cast<const string&>(s));
+      return;
+    }
+
+    if (type == uc_String && inline_room == HEAP_STRING &&
+	ref_unique(data.str->refcount)) {
+      data.str->value.swap(s);
+      set_dirty();
+      return;
     }
-    else { //starting fresh
-      refcount = new unsigned;
-      *refcount = 1;
+
+    UniversalContainer old;
+    swap_contents(old);
+
+    data.str = new UCShared<string>(std::move(s));
+    inline_room = HEAP_STRING;
+    type = uc_String;
+    set_dirty();
+  }
+#endif
+
+  void UniversalContainer::set_value_wstring(const wstring& s)
+  {
+    if (type == uc_WString && ref_unique(data.wstr->refcount)) {
+      data.wstr->value = s;
+      set_dirty();
+      return;
     }
+
+    UniversalContainer old;
+    swap_contents(old);
     
     type = uc_WString;
-    dirty = true;
-    data.wstr = new wstring(s); 
+    set_dirty();
+    data.wstr = new_shared<wstring>(value_arena());
+    data.wstr->value = s;
+    note_external();
+  }
+
+  //points at s rather than copying it. s must be nul terminated at
+  //len, and must outlive this container and every copy made of it.
+  //Short strings are copied inline anyway.
+  void UniversalContainer::borrow_string(const char* s, size_t len)
+  {
+    if (len <= uc_Inline_Length || len != (unsigned short) len) {
+      set_value_string(string(s,len));
+      return;
+    }
+
+    release();
+    data.span = s;
+    span_length = len;
+    inline_room = SPAN_STRING;
+    type = uc_String;
+    set_dirty();
+  }
+
+  //move an inline or span string out to the heap, for callers that
+  //need a real std::string to point at
+  void UniversalContainer::spill_string(void)
+  {
+    UCShared<string>* s = new UCShared<string>(string(string_chars(),string_length()));
+    data.str = s;
+    inline_room = HEAP_STRING;
+    note_external();
+  }
+
+  const char* UniversalContainer::string_chars(void) const
+  {
+    if (inline_room == HEAP_STRING) return data.str->value.c_str();
+    if (inline_room == SPAN_STRING) return data.span;
+    return chars;
+  }
+
+  size_t UniversalContainer::string_length(void) const
+  {
+    if (inline_room == HEAP_STRING) return data.str->value.length();
+    if (inline_room == SPAN_STRING) return span_length;
+    return uc_Inline_Length - inline_room;
   }
 
   void UniversalContainer::set_value_cstr(const char* s)
@@ -134,25 +797,152 @@ namespace JAD {
     }
   }
 
-  /*
-    Create new container types.
-   */ 
-  void UniversalContainer::init_map(void)
+  /*
+    Create new container types.
+   */ 
+  void UniversalContainer::init_map(void)
+  {
+    release();
+    type = uc_Map;
+    data.map = new_shared<UCMapStorage>(value_arena());
+    set_dirty();
+    if (home) {
+      UCTrackLock lock;
+      add_owner(tracking(),home);
+    }
+  }
+
+  void UniversalContainer::init_array(void)
+  {
+    release();
+    type = uc_Array;
+    data.ray = new_shared<UCArrayStorage>(value_arena());
+    set_dirty();
+    if (home) {
+      UCTrackLock lock;
+      add_owner(tracking(),home);
+    }
+  }
+
+  /*
+    A deferred map or array is made empty, with a filler that adds its
+    elements. Everything that reads a collection's storage goes through
+    map_storage or array_storage, which run the filler the first time.
+    Only the refcounting and dirty tracking reach the storage directly,
+    and neither needs the elements of a collection never looked at.
+   */
+  void UniversalContainer::init_deferred(UniversalContainerType t,
+					 UCDeferred* filler)
+  {
+    if (t == uc_Map) {
+      init_map();
+      data.map->value.deferred = filler;
+    }
+    else {
+      init_array();
+      data.ray->value.deferred = filler;
+    }
+#ifdef UC_ARENA
+    //the filler is on the heap
+    if (UCArena* arena = tracking()->arena) arena->add_external();
+#endif
+  }
+
+  //true until the filler has run. Under UC_THREADSAFE the filler is
+  //swapped out while it runs, so it is read atomically.
+  static inline bool unfilled(UCDeferred* const& deferred)
+  {
+#ifdef UC_THREADSAFE
+    return __atomic_load_n(&deferred,__ATOMIC_ACQUIRE) != NULL;
+#else
+    return deferred != NULL;
+#endif
+  }
+
+  UCMapStorage& UniversalContainer::map_storage(void) const
   {
-    type = uc_Map;
-    data.map = new UniversalMap;
-    refcount = new unsigned;
-    (*refcount) = 1;
-    dirty = true;
+    UCMapStorage& m = data.map->value;
+    if (unfilled(m.deferred)) fill_deferred(m.deferred);
+    return m;
   }
 
-  void UniversalContainer::init_array(void)
+  UCArrayStorage& UniversalContainer::array_storage(void) const
   {
-    type = uc_Array;
-    data.ray = new UniversalArray;
-    refcount = new unsigned;
-    (*refcount) = 1;
-    dirty = true;
+    UCArrayStorage& a = data.ray->value;
+    if (unfilled(a.deferred)) fill_deferred(a.deferred);
+    return a;
+  }
+
+  /*
+    Under UC_THREADSAFE several threads may read one unfilled
+    collection at once. The first swaps the filler for filling_mark,
+    and the rest wait until the slot is cleared, which is done only
+    once every element is made. The filling thread reaches the storage
+    again as it adds elements, and is let through by filling_now.
+   */
+#ifdef UC_THREADSAFE
+  static char filling_byte;
+  static UCDeferred* const filling_mark =
+    reinterpret_cast<UCDeferred*>(&filling_byte);
+  static __thread UCDeferred** filling_now = NULL;
+#endif
+
+  //ends a fill, however it ends: the slot is cleared and the filler
+  //deleted. A filler that throws leaves the elements it made.
+  struct UCFilling {
+    UCDeferred*& deferred;
+    UCDeferred* filler;
+#ifdef UC_THREADSAFE
+    UCDeferred** outer;
+
+    UCFilling(UCDeferred*& d, UCDeferred* f) : deferred(d), filler(f),
+					       outer(filling_now)
+    {
+      filling_now = &deferred;
+    }
+
+    ~UCFilling(void)
+    {
+      filling_now = outer;
+      __atomic_store_n(&deferred,(UCDeferred*) NULL,__ATOMIC_RELEASE);
+      delete filler;
+    }
+#else
+    UCFilling(UCDeferred*& d, UCDeferred* f) : deferred(d), filler(f)
+    {
+      deferred = NULL;
+    }
+
+    ~UCFilling(void) { delete filler; }
+#endif
+  };
+
+  //the filler is handed a copy sharing the storage, so it can add
+  //elements the usual way. Filling is a read, and the dirty flag that
+  //adding sets lands on the copy, leaving this one as it was. The new
+  //elements are as dirty as they would be had they been there all
+  //along, so they are cleaned if the collection has been.
+  void UniversalContainer::fill_deferred(UCDeferred*& deferred) const
+  {
+#ifdef UC_THREADSAFE
+    UCDeferred* filler = __atomic_load_n(&deferred,__ATOMIC_ACQUIRE);
+    for (;;) {
+      if (!filler || filling_now == &deferred) return;
+      if (filler == filling_mark) {
+	sched_yield();
+	filler = __atomic_load_n(&deferred,__ATOMIC_ACQUIRE);
+      }
+      else if (__atomic_compare_exchange_n(&deferred,&filler,filling_mark,false,
+					   __ATOMIC_ACQUIRE,__ATOMIC_ACQUIRE))
+	break;
+    }
+#else
+    UCDeferred* filler = deferred;
+#endif
+    UCFilling filling(deferred,filler);
+    UniversalContainer self(*this);
+    filler->fill(self);
+    if (self.tracking()->fill_clean) self.clean();
   }
 
   /*
@@ -162,181 +952,280 @@ namespace JAD {
 
   UniversalContainer::UniversalContainer(void)
   {
+    init_flags();
     type = uc_Null;
-    refcount = NULL;
+    inline_room = 0;
     data.str = NULL;
-    dirty = true;
   }
 
   UniversalContainer::UniversalContainer(int i)
   {
-    refcount = NULL;
+    init_flags();
     set_value_integer(i);
   }
 
   UniversalContainer::UniversalContainer(long l)
   {
-    refcount = NULL;
+    init_flags();
     set_value_integer(l);
   }
 
   UniversalContainer::UniversalContainer(char c)
   {
-    refcount = NULL;
+    init_flags();
     set_value_char(c);
   }
 
   UniversalContainer::UniversalContainer(bool b)
   {
-    refcount = NULL;
+    init_flags();
     set_value_bool(b);
   }
 
   UniversalContainer::UniversalContainer(double d)
   {
-    refcount = NULL;
+    init_flags();
     set_value_double(d);
   }
 
-  UniversalContainer::UniversalContainer(const string s)
+  UniversalContainer::UniversalContainer(const string& s)
   {
-    refcount = NULL;
+    init_flags();
+    type = uc_Null;
     set_value_string(s);
     return;
   }
 
-  UniversalContainer::UniversalContainer(const wstring s)
+#ifdef UC_MOVE_SEMANTICS
+  UniversalContainer::UniversalContainer(string&& s)
+  {
+    init_flags();
+    type = uc_Null;
+    set_value_string(std::move(s));
+  }
+#endif
+
+  UniversalContainer::UniversalContainer(const wstring& s)
   {
-    refcount = NULL;
+    init_flags();
+    type = uc_Null;
     set_value_wstring(s);
     return;
   }
 
   UniversalContainer::UniversalContainer(char* s)
   {
-    refcount = NULL;
+    init_flags();
+    type = uc_Null;
     set_value_cstr(s);
     return;
   }
 
   /*
-    Deletion is tricky. If we are the referning container, clean up
-    both the container and refcount.
+    Strings, maps and arrays live in a UCShared block on the heap,
+    which carries the count of containers pointing at it. The last
+    container to let go deletes the block.
    */
-  UniversalContainer::~UniversalContainer(void)
+  bool UniversalContainer::shared(void) const
   {
-    if (refcount) {
-      (*refcount)--;
-      if ((*refcount) == 0) {
-	switch(type) {
-	case uc_String :
-	  delete data.str;
-	  break;
-	case uc_WString :
-	  delete data.wstr;
-	  break;
-	case uc_Map :
-	  delete data.map;
-	  break;
-	case uc_Array :
-	  delete data.ray;
-	  break;
-	default : ;
-	}
-	delete refcount;
-      } //refcount==0
-    } //if refcount
+    switch(type) {
+    case uc_String :
+      return inline_room == HEAP_STRING;
+    case uc_WString :
+    case uc_Map :
+    case uc_Array :
+      return true;
+    default :
+      return false;
+    }
   }
 
-  //designated code for copy constructor and operator=(UniversalContainer) 
-  void UniversalContainer::duplicate(const UniversalContainer& uc)
+  void UniversalContainer::retain(void)
   {
-    type = uc.type;
-    refcount = uc.refcount;
-    if (refcount) (*refcount)++;
-
+    if (!shared()) return;
     switch(type) {
-    case uc_Map :
-      data.map = uc.data.map;
-      break;
-    case uc_Array :
-      data.ray = uc.data.ray;
-      break;
-    case uc_Integer :
-      data.num = uc.data.num;
+    case uc_String :
+      ref_acquire(data.str->refcount);
       break;
-    case uc_Real :
-      data.real = uc.data.real;
+    case uc_WString :
+      ref_acquire(data.wstr->refcount);
       break;
-    case uc_Boolean :
-      data. tf = uc.data.tf;
+    case uc_Map :
+      ref_acquire(data.map->refcount);
       break;
-    case uc_Character : 
-      data.chr = uc.data.chr;
+    case uc_Array :
+      ref_acquire(data.ray->refcount);
       break;
+    default : ;
+    }
+  }
+
+  //drops our reference, does not change the type
+  void UniversalContainer::release(void)
+  {
+    if (!shared()) return;
+    if (home && (type == uc_Map || type == uc_Array)) {
+      UCTrackLock lock;
+      drop_owner(tracking(),home);
+    }
+    switch(type) {
     case uc_String :
-      data.str = uc.data.str;
+      if (ref_drop(data.str->refcount)) delete_shared(data.str);
       break;
     case uc_WString :
-      data.wstr = uc.data.wstr;
+      if (ref_drop(data.wstr->refcount)) delete_shared(data.wstr);
+      break;
+    case uc_Map :
+      if (ref_drop(data.map->refcount)) delete_collection(data.map);
+      break;
+    case uc_Array :
+      if (ref_drop(data.ray->refcount)) delete_collection(data.ray);
       break;
     default : ;
     }
+  }
+
+  //swaps values, dirty flags included, but each side keeps its place
+  //in or out of the arena, and its home
+  void UniversalContainer::swap_contents(UniversalContainer& uc)
+  {
+    char tmp[sizeof(bytes)];
+    unsigned mine = home;
+    unsigned theirs = uc.home;
+    bool scope = in_scope;
+    memcpy(tmp,bytes,sizeof(bytes));
+    memcpy(bytes,uc.bytes,sizeof(bytes));
+    memcpy(uc.bytes,tmp,sizeof(bytes));
+    uc.in_scope = in_scope;
+    in_scope = scope;
+    home = mine;
+    uc.home = theirs;
+    note_external();
+    uc.note_external();
+
+    //what each home counts goes with the values. nothing changes
+    //within one collection, or for two scalars equally dirty.
+    if (mine == theirs) return;
+    if (dirty == uc.dirty && !tracking() && !uc.tracking()) return;
+    UCTrackLock lock;
+    if (mine) {
+      join_home(mine);
+      uc.leave_home(mine);
+    }
+    if (theirs) {
+      uc.join_home(theirs);
+      leave_home(theirs);
+    }
+  }
+
+  UniversalContainer::~UniversalContainer(void)
+  {
+    if (dirty && home) {
+      UCTrackLock lock;
+      count_down(home);
+    }
+    release();
+  }
 
-    dirty = uc.dirty;
+  //designated code for the copy constructor
+  void UniversalContainer::duplicate(const UniversalContainer& uc)
+  {
+    memcpy(bytes,uc.bytes,sizeof(bytes));
+    retain();
   }
 
+  //a copy is in no collection, wherever the original is
   UniversalContainer::UniversalContainer(const UniversalContainer& uc)
   {
     duplicate(uc);
+    home = 0;
+  }
+
+#ifdef UC_MOVE_SEMANTICS
+  //takes over uc's contents without touching the reference count,
+  //leaving uc null
+  UniversalContainer::UniversalContainer(UniversalContainer&& uc) noexcept
+  {
+    memcpy(bytes,uc.bytes,sizeof(bytes));
+    home = 0;
+    if (uc.home && uc.tracking()) {
+      UCTrackLock lock;
+      drop_owner(uc.tracking(),uc.home);
+    }
+    uc.type = uc_Null;
   }
+#endif
 
   //map brackets does the actual work of operator[string]
   //it understand . notation to reach nested maps
-  UniversalContainer& UniversalContainer::map_brackets(const string s)
+  UniversalContainer& UniversalContainer::map_brackets(const string& s)
   {
-    unsigned long pos;
-    bool ismap;
-    int idx;
-    std::string piece1;
-    std::string piece2;
-	
-    //split input into first argument and rest
-    pos = s.find('.');
-    piece1 = s.substr(0,pos);
-    if (pos != string::npos) piece2 = s.substr(pos+1);
-	
-    //double check that this isn't really supposed to be a string
-    if (type == uc_Map) ismap = true;
-    else {
-      errno = 0;
-      idx = strtol(piece1.c_str(),NULL,10);
-      if (errno) ismap = true;
-      else ismap = false;
+    int idx = 0;
+
+    //a dotted key names a path, resolve the first piece then the rest
+    size_t pos = s.find('.');
+    if (pos != string::npos) {
+      string rest = s.substr(pos+1);
+      UniversalContainer& head = map_brackets(s.substr(0,pos));
+      if (rest == "") return head;
+      else return head[rest];
     }
 
-    if (ismap) {
+    bool numeric = parse_index(s,idx);
+    return path_step(s,numeric,idx);
+  }
+
+  //true if key is a whole decimal number that fits in an int
+  bool UniversalContainer::parse_index(const string& key, int& idx)
+  {
+    if (key.empty()) return false;
+    char* end;
+    errno = 0;
+    long l = strtol(key.c_str(),&end,10);
+    if (*end || errno || l > numeric_limits<int>::max() ||
+	l < numeric_limits<int>::min())
+      return false;
+    idx = l;
+    return true;
+  }
+
+  //one step along a path. numeric keys index arrays, unless
+  //this is already a map. missing elements are created.
+  UniversalContainer& UniversalContainer::path_step(const string& key,
+						    bool numeric, int idx)
+  {
+    if (type != uc_Map) {
+      if (numeric) {
+	if (type == uc_Null) init_array();
+	if (type != uc_Array)
+	  throw internal_ucexception(uce_Scalar_as_Collection);
+	return (this->operator[](idx));
+      }
       if (type == uc_Null) init_map(); //if this is my first apparence, setup
       if (type != uc_Map)
 	throw internal_ucexception(uce_Scalar_as_Collection);
-      if (piece2 == "") return (*(data.map))[piece1];
-      else return (*(data.map))[piece1][piece2];
     }
-    else { //isarray
-      if (type == uc_Null) init_array();
-      if (type != uc_Array)
-	throw internal_ucexception(uce_Scalar_as_Collection);
-      if (piece2 == "") return (this->operator[](idx));
-      else return (this->operator[](idx))[piece2];
+    return map_element(key);
+  }
+
+  //as path_step, but returns NULL rather than create or throw
+  UniversalContainer* UniversalContainer::find_step(const string& key,
+						    bool numeric, int idx) const
+  {
+    if (type == uc_Map) return map_find(key);
+    if (numeric && type == uc_Array && idx >= 0) {
+      UniversalArray& items = array_storage().items;
+      if ((size_t)idx < items.size()) return &items[idx];
     }
+    return NULL;
   }
 
-  UniversalContainer& UniversalContainer::operator[](const string s)
+  UniversalContainer& UniversalContainer::operator[](const string& s)
   {
     return map_brackets(s);
   }
 
-  UniversalContainer& UniversalContainer::operator[](const wstring w)
+  UniversalContainer& UniversalContainer::operator[](const wstring& w)
   {
     return map_brackets(convert_wstring_to_string(&w));
   }
@@ -361,16 +1250,19 @@ namespace JAD {
     if (type != uc_Array) 
       throw internal_ucexception(uce_Non_Array_as_Array);
 	
-    int sz = data.ray->size();
+    UniversalArray& items = array_storage().items;
+    int sz = items.size();
     if (i == -1) i = sz;
+    if (i > sz || i < 0)
+      throw internal_ucexception(uce_Array_Subscript_Out_of_Bounds);
     if (i == sz) {
-      dirty = true;
+      set_dirty();
       UniversalContainer uc;
-      data.ray->push_back(uc);
+      uc.in_scope = data.ray->in_arena;
+      items.push_back(uc);
+      stamp_added(items.back());
     }
-    if (i > sz || i < 0)
-      throw internal_ucexception(uce_Array_Subscript_Out_of_Bounds);
-    return data.ray->at(i);
+    return items[i];
   }
 
   /*
@@ -431,6 +1323,17 @@ namespace JAD {
     return *this;
   }
 
+#ifdef UC_MOVE_SEMANTICS
+  UniversalContainer& UniversalContainer::operator=(string&& s)
+  {
+    if (!(type == uc_String || type == uc_Null))
+      throw internal_ucexception(uce_TypeMismatch_Write);
+  
+    set_value_string(std::move(s));
+    return *this;
+  }
+#endif
+
   UniversalContainer& UniversalContainer::operator=(const char* s)
   {
     if (!(type == uc_String || type == uc_Null))
@@ -449,17 +1352,30 @@ namespace JAD {
     return *this;
   }
 
+  //take the new reference before releasing the old one, since uc may
+  //live inside the collection we are letting go of
   UniversalContainer& UniversalContainer::operator=(const UniversalContainer& uc)
   {
-    if (this != &uc) duplicate(uc);
+    UniversalContainer tmp(uc);
+    swap_contents(tmp);
+    return *this;
+  }
+
+#ifdef UC_MOVE_SEMANTICS
+  //as above, uc may live inside what we are replacing
+  UniversalContainer& UniversalContainer::operator=(UniversalContainer&& uc) noexcept
+  {
+    UniversalContainer tmp(std::move(uc));
+    swap_contents(tmp);
     return *this;
   }
+#endif
 
   //utilities for casting strings to longs
-  long UniversalContainer::convert_string_to_long(const string* s) 
+  long UniversalContainer::convert_string_to_long(const char* s) 
   {
     errno = 0;
-    long l = strtol(s->c_str(),NULL,10);
+    long l = strtol(s,NULL,10);
     if (errno) throw ucexception(uce_TypeMismatch_Read);
     return l;
   }
@@ -467,7 +1383,7 @@ namespace JAD {
   long UniversalContainer::convert_wstring_to_long(const wstring* s)
   {
     string tmp = convert_wstring_to_string(s);
-    return convert_string_to_long(&tmp);
+    return convert_string_to_long(tmp.c_str());
   }
 
   /*
@@ -492,10 +1408,10 @@ namespace JAD {
     case uc_Character :
       return static_cast<long>(data.chr);
     case uc_String :
-      retval = convert_string_to_long(data.str);
+      retval = convert_string_to_long(string_chars());
       break;
     case uc_WString :
-      retval = convert_wstring_to_long(data.wstr);
+      retval = convert_wstring_to_long(&data.wstr->value);
       break;
     case uc_Map :
     case uc_Array :
@@ -509,7 +1425,7 @@ namespace JAD {
     if (retval > std::numeric_limits<int>::max() ||
 	retval < std::numeric_limits<int>::min())
       throw internal_ucexception(uce_TypeMismatch_Read);
-    else return static_cast<int>(data.num);
+    else return static_cast<int>(retval);
   
     return retval;
   }
@@ -527,9 +1443,9 @@ namespace JAD {
     case uc_Character :
       return static_cast<char>(data.chr);
     case uc_String :
-      return convert_string_to_long(data.str);
+      return convert_string_to_long(string_chars());
     case uc_WString :
-      return convert_wstring_to_long(data.wstr);
+      return convert_wstring_to_long(&data.wstr->value);
     case uc_Map :
     case uc_Array :
       throw internal_ucexception(uce_Collection_as_Scalar);
@@ -548,9 +1464,9 @@ namespace JAD {
 	
     switch (type) {
     case uc_String :
-      return *(data.str);
+      return string(string_chars(),string_length());
     case uc_WString :
-      return convert_wstring_to_string(data.wstr);
+      return convert_wstring_to_string(&data.wstr->value);
     case uc_Integer :
       snprintf(buf,32,"%ld",data.num);
       return string(buf);
@@ -587,10 +1503,10 @@ namespace JAD {
   
     switch (type) {
     case uc_WString :
-      retval = *(data.wstr);
+      retval = data.wstr->value;
       return retval;
     case uc_String :
-      tmp = *(data.str);
+      tmp.assign(string_chars(),string_length());
       break;
     case uc_Integer :
       snprintf(buf,32,"%ld",data.num);
@@ -621,23 +1537,29 @@ namespace JAD {
     return convert_string_to_wstring(&tmp);
   }
   
+  //an inline string has no std::string to hand out, so it is moved to
+  //the heap first
   UniversalContainer::operator std::string*(void) const
   {
-    if (type == uc_String) return data.str;
+    if (type == uc_String) {
+      if (inline_room != HEAP_STRING)
+	const_cast<UniversalContainer*>(this)->spill_string();
+      return &data.str->value;
+    }
     if (type == uc_Null) return NULL;
     throw internal_ucexception(uce_TypeMismatch_Read);
   }
 
   const char* UniversalContainer::c_str(void) const
   {
-    if (type == uc_String) return data.str->c_str();
+    if (type == uc_String) return string_chars();
     if (type == uc_Null) return NULL;
     throw internal_ucexception(uce_TypeMismatch_Read);    
   }
 
   UniversalContainer::operator std::wstring*(void) const
   {
-    if (type == uc_WString) return data.wstr;
+    if (type == uc_WString) return &data.wstr->value;
     if (type == uc_Null) return NULL;
     throw internal_ucexception(uce_TypeMismatch_Read);
   }
@@ -651,7 +1573,7 @@ namespace JAD {
       if (data.tf) return 't';
       else return 'f';
     case uc_String :
-      return data.str->c_str()[0];
+      return string_chars()[0];
     case uc_WString :
     case uc_Integer :
     case uc_Real :
@@ -683,13 +1605,16 @@ namespace JAD {
       return (data.real != 0.0);
       break;
     case uc_String :
-      if (!data.str->compare(TRUE_STR) || !data.str->compare(true_str)) return true;
-      else if(!data.str->compare(FALSE_STR) || !data.str->compare(false_str)) return false;
+      if (!strcmp(string_chars(),TRUE_STR) || !strcmp(string_chars(),true_str))
+	return true;
+      else if(!strcmp(string_chars(),FALSE_STR) ||
+	      !strcmp(string_chars(),false_str))
+	return false;
       throw internal_ucexception(uce_TypeMismatch_Read);
     case uc_WString :
       throw internal_ucexception(uce_TypeMismatch_Read);
     case uc_Map :
-      if (exists(BOOL_VAL_STR)) return (*(data.map))[BOOL_VAL_STR];
+      if (exists(BOOL_VAL_STR)) return *map_find(BOOL_VAL_STR);
       else return true;
     case uc_Array :
       return true;
@@ -703,15 +1628,14 @@ namespace JAD {
     return false;
   }
 
-  double UniversalContainer::convert_string_to_double(const string* s) 
+  double UniversalContainer::convert_string_to_double(const char* s, size_t len) 
   {
     double retval;
     char* ptr;
     errno = 0;
 
-    retval = strtod(s->c_str(),&ptr);
-    if (errno || (retval == 0.0 &&
-		  ptr != (s->c_str() + s->length())))
+    retval = strtod(s,&ptr);
+    if (errno || (retval == 0.0 && ptr != (s + len)))
       throw ucexception(uce_TypeMismatch_Read);
     return retval;
   }
@@ -719,7 +1643,7 @@ namespace JAD {
   double UniversalContainer::convert_wstring_to_double(const wstring* s) 
   {
     string tmp = convert_wstring_to_string(s);
-    return convert_string_to_double(&tmp);
+    return convert_string_to_double(tmp.c_str(),tmp.length());
   }
 
   double UniversalContainer::convert_double(void) const
@@ -735,9 +1659,9 @@ namespace JAD {
     case uc_Character :
       return static_cast<double>(data.chr);
     case uc_String :
-      return convert_string_to_double(data.str);
+      return convert_string_to_double(string_chars(),string_length());
     case uc_WString :
-      return convert_wstring_to_double(data.wstr);
+      return convert_wstring_to_double(&data.wstr->value);
     case uc_Map :
     case uc_Array :
       throw internal_ucexception(uce_Collection_as_Scalar);
@@ -804,8 +1728,7 @@ namespace JAD {
     if (type != uc_Null)
       throw internal_ucexception(uce_TypeMismatch_Write);
 
-    dirty = true;
-    refcount = NULL;
+    set_dirty();
     len = strlen(str);
     const char* last = str + len;
 
@@ -869,11 +1792,7 @@ namespace JAD {
     bool done = true;
 	
     clone.type = type;
-    if (type == uc_String || type == uc_WString || type == uc_Map ||
-	type == uc_Array) {
-      clone.refcount = new unsigned;
-      *(clone.refcount) = 1;
-    }
+    clone.inline_room = inline_room;
     clone.dirty = dirty;
 
     switch(type) {
@@ -890,10 +1809,17 @@ namespace JAD {
       clone.data.chr = data.chr;
       break;
     case uc_String :
-      clone.data.str = new std::string(*(data.str));
+      if (inline_room <= uc_Inline_Length)
+	memcpy(clone.chars,chars,sizeof(chars));
+      else { //copied to the heap, or to the current arena
+	clone.type = uc_Null;
+	clone.set_value_string(string(string_chars(),string_length()));
+	clone.dirty = dirty;
+      }
       break;
     case uc_WString :
-      clone.data.wstr = new std::wstring(*(data.wstr));
+      clone.data.wstr = new_shared<std::wstring>(clone.value_arena());
+      clone.data.wstr->value = data.wstr->value;
       break;
     case uc_Null :
       break;
@@ -903,18 +1829,20 @@ namespace JAD {
 	
     if (!done) {
       if (type == uc_Map) {
-	clone.data.map = new UniversalMap;
-	UniversalMap::iterator im;
-	UniversalMap::iterator mend = data.map->end();
-	for (im = data.map->begin(); im != mend; im++) 
-	  (*(clone.data.map))[im->first] = im->second.clone();
+	clone.data.map = new_shared<UCMapStorage>(clone.value_arena());
+	std::vector<UniversalMapEntry> entries = sorted_map_entries();
+	for (size_t i = 0; i < entries.size(); i++)
+	  clone.map_element(*entries[i].first) = entries[i].second->clone();
       }
       else if (type == uc_Array) {
-	clone.data.ray = new UniversalArray;
+	clone.data.ray = new_shared<UCArrayStorage>(clone.value_arena());
+	UniversalArray& items = array_storage().items;
 	UniversalArray::iterator ia;
-	UniversalArray::iterator aend = data.ray->end();
-	for (ia = data.ray->begin(); ia != aend; ia++)
-	  (clone.data.ray)->push_back(ia->clone());
+	UniversalArray::iterator aend = items.end();
+	for (ia = items.begin(); ia != aend; ia++)
+	  clone.data.ray->value.items.push_back(ia->clone());
+	UCTrackLock lock;
+	clone.stamp_elements();
       }
       else throw internal_ucexception(uce_Unknown);
     }
@@ -925,51 +1853,46 @@ namespace JAD {
   //get real c++ iterators
   UniversalMap::iterator UniversalContainer::map_begin(void) const
   {
-    if (type == uc_Map) return data.map->begin();
-    else throw internal_ucexception(uce_TypeMismatch_Read);
+    if (type != uc_Map) throw internal_ucexception(uce_TypeMismatch_Read);
+    UniversalMap* tree = map_tree();
+    expose(tracking());
+    return tree->begin();
   }
 
   UniversalMap::iterator UniversalContainer::map_end(void) const
   {
-    if (type == uc_Map) return data.map->end();
-    else throw internal_ucexception(uce_TypeMismatch_Read);
+    if (type != uc_Map) throw internal_ucexception(uce_TypeMismatch_Read);
+    UniversalMap* tree = map_tree();
+    expose(tracking());
+    return tree->end();
   }
 
   UniversalArray::iterator UniversalContainer::vector_begin(void) const
   {
-    if (type == uc_Array) return data.ray->begin();
-    else throw internal_ucexception(uce_TypeMismatch_Read);
+    if (type != uc_Array) throw internal_ucexception(uce_TypeMismatch_Read);
+    expose(tracking());
+    return array_storage().items.begin();
   }
 
   UniversalArray::iterator UniversalContainer::vector_end(void) const
   {
-    if (type == uc_Array) return data.ray->end();
-    else throw internal_ucexception(uce_TypeMismatch_Read);
+    if (type != uc_Array) throw internal_ucexception(uce_TypeMismatch_Read);
+    expose(tracking());
+    return array_storage().items.end();
   }
 
   //null out an object. logically, uc = NULL
   void UniversalContainer::clear(void)
   {
-    if (refcount) {
-      if ((*refcount) > 1) (*refcount)--;
-      if (!(*refcount)) {
-	delete refcount;
-	if (type == uc_String) delete data.str;
-	else if (type == uc_WString) delete data.wstr;
-	else if (type == uc_Map) delete data.map;
-	else if (type == uc_Array) delete data.ray;
-      }
-    }
-	
-    refcount = NULL;
-    dirty = true;
+    release();
+    set_dirty();
     type = uc_Null;
   }
 
   //true if this is a map, and it contains the given key
-  bool UniversalContainer::exists(const string key) const
+  bool UniversalContainer::exists(const string& key) const
   {
-    if (type == uc_Map) return (data.map->count(key) > 0);
+    if (type == uc_Map) return map_find(key) != NULL;
     else return false;
   }
 
@@ -981,10 +1904,14 @@ namespace JAD {
 
   size_t UniversalContainer::length(void) const
   {
-    if (type == uc_Map) return data.map->size();
-    else if (type == uc_Array) return data.ray->size();
-    else if (type == uc_String) return data.str->length();
-    else if (type == uc_WString) return data.wstr->length();
+    if (type == uc_Map) {
+      UCMapStorage& m = map_storage();
+      if (UniversalMap* tree = tree_of(m)) return tree->size();
+      return m.flat.size();
+    }
+    else if (type == uc_Array) return array_storage().items.size();
+    else if (type == uc_String) return string_length();
+    else if (type == uc_WString) return data.wstr->value.length();
     else if (type == uc_Null) return 0;
     else throw internal_ucexception(uce_TypeMismatch_Read);
   }
@@ -992,23 +1919,183 @@ namespace JAD {
   //get routines, to expose the underlying stl objects just in case
   UniversalMap* UniversalContainer::get_map(void) const
   {
-    if (type == uc_Map) return data.map;
-    else throw internal_ucexception(uce_TypeMismatch_Read);
+    if (type != uc_Map) throw internal_ucexception(uce_TypeMismatch_Read);
+    UniversalMap* tree = map_tree();
+    expose(tracking());
+    return tree;
   }
 
   UniversalArray* UniversalContainer::get_vector(void) const
   {
-    if (type == uc_Array) return data.ray;
-    else throw internal_ucexception(uce_TypeMismatch_Read);
+    if (type != uc_Array) throw internal_ucexception(uce_TypeMismatch_Read);
+    expose(tracking());
+    return &array_storage().items;
+  }
+
+  //the elements, for callers that only read them, so not pinned
+  UniversalArray& UniversalContainer::array_items(void) const
+  {
+    if (type != uc_Array) throw internal_ucexception(uce_Non_Array_as_Array);
+    return array_storage().items;
+  }
+
+  /*
+    Map storage. These work on whichever form the map is in, and only
+    map_tree moves a small map out of its flat vector.
+   */
+
+  /*
+    The tree, made from the flat entries if need be. map_begin, map_end
+    and get_map are const, and when built with UC_THREADSAFE other
+    threads may be reading the flat entries, so they are copied rather
+    than moved, and if two threads race to build the tree the first one
+    published is kept. The flat copies are freed when the map is next
+    written through brackets.
+   */
+  UniversalMap* UniversalContainer::map_tree(void) const
+  {
+    UCMapStorage& m = map_storage();
+#ifdef UC_ARENA
+    //the tree goes where the flat entries are, whatever scope is active
+    UCArenaScope scope(m.flat.get_allocator().arena);
+#endif
+#ifdef UC_THREADSAFE
+    UniversalMap* tree = tree_of(m);
+    if (!tree) {
+      UniversalMap* made = new_tree(m);
+      UniversalFlatMap::const_iterator end = m.flat.end();
+      for (UniversalFlatMap::const_iterator i = m.flat.begin(); i != end; i++)
+	made->insert(UniversalMap::value_type(i->first,i->second));
+      {
+	UCTrackLock lock;
+	if (unsigned index = index_of(&m)) {
+	  UniversalMap::iterator end = made->end();
+	  for (UniversalMap::iterator i = made->begin(); i != end; i++)
+	    stamp(i->second,index);
+	}
+      }
+      if (__atomic_compare_exchange_n(&m.tree,&tree,made,false,
+				      __ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE))
+	tree = made;
+      else delete_tree(m,made);
+    }
+    return tree;
+#else
+    if (!m.tree) {
+      m.tree = new_tree(m);
+      UniversalFlatMap::iterator end = m.flat.end();
+      for (UniversalFlatMap::iterator i = m.flat.begin(); i != end; i++)
+	(*m.tree)[i->first].swap_contents(i->second);
+      UniversalFlatMap(m.flat.get_allocator()).swap(m.flat);
+      UCTrackLock lock;
+      stamp_elements();
+    }
+    return m.tree;
+#endif
+  }
+
+  //the value stored under key, or NULL
+  UniversalContainer* UniversalContainer::map_find(const string& key) const
+  {
+    UCMapStorage& m = map_storage();
+    if (UniversalMap* tree = tree_of(m)) {
+      UniversalMap::iterator i = tree->find(key);
+      if (i == tree->end()) return NULL;
+      return &i->second;
+    }
+    UniversalFlatMap::iterator i = flat_position(m.flat,key);
+    if (i == m.flat.end() || i->first != key) return NULL;
+    return &i->second;
+  }
+
+  //the value stored under key, added as null if absent
+  UniversalContainer& UniversalContainer::map_element(const string& key)
+  {
+    UCMapStorage& m = map_storage();
+    if (!tree_of(m)) {
+      UniversalFlatMap::iterator i = flat_position(m.flat,key);
+      if (i != m.flat.end() && i->first == key) return i->second;
+      if (m.flat.size() < uc_Flat_Map_Limit) {
+	i = m.flat.insert(i,UniversalFlatMap::value_type(key,UniversalContainer()));
+	i->second.in_scope = data.map->in_arena;
+	note_key(m,key);
+	UCTrackLock lock;
+	stamp_elements(); //the insert moved those after it
+	return i->second;
+      }
+    }
+    UniversalMap* tree = map_tree();
+    UniversalMap::iterator i = tree->find(key);
+    if (i != tree->end()) return i->second;
+    if (!m.flat.empty()) //copied by map_tree
+      UniversalFlatMap(m.flat.get_allocator()).swap(m.flat);
+    UniversalContainer& element = (*tree)[key];
+    element.in_scope = data.map->in_arena;
+    note_key(m,key);
+    stamp_added(element);
+    return element;
+  }
+
+  std::vector<UniversalMapEntry> UniversalContainer::map_entries(void) const
+  {
+    UCMapStorage& m = map_storage();
+    std::vector<UniversalMapEntry> entries;
+    if (UniversalMap* tree = tree_of(m)) {
+      entries.reserve(tree->size());
+      UniversalMap::iterator end = tree->end();
+      for (UniversalMap::iterator i = tree->begin(); i != end; i++)
+	entries.push_back(UniversalMapEntry(&i->first,&i->second));
+    }
+    else {
+      entries.reserve(m.flat.size());
+      UniversalFlatMap::iterator end = m.flat.end();
+      for (UniversalFlatMap::iterator i = m.flat.begin(); i != end; i++)
+	entries.push_back(UniversalMapEntry(&i->first,&i->second));
+    }
+    return entries;
+  }
+
+#ifdef UC_HASH_MAP
+  static bool entry_key_less(const UniversalMapEntry& a,
+			     const UniversalMapEntry& b)
+  {
+    return *a.first < *b.first;
+  }
+#endif
+
+  //the map's entries in key order, whichever form the map is in.
+  //encoders use this to keep their output stable.
+  std::vector<UniversalMapEntry> UniversalContainer::sorted_map_entries(void) const
+  {
+    if (type != uc_Map)
+      throw internal_ucexception(uce_Non_Map_as_Map);
+
+    std::vector<UniversalMapEntry> entries = map_entries();
+#ifdef UC_HASH_MAP
+    if (tree_of(map_storage()))
+      std::sort(entries.begin(),entries.end(),entry_key_less);
+#endif
+    return entries;
   }
 
   //delete a key from a map
-  bool UniversalContainer::remove(const string key)
+  bool UniversalContainer::remove(const string& key)
   {
     if (type != uc_Map) throw internal_ucexception(uce_TypeMismatch_Read);
-    UniversalMap::iterator pos = data.map->find(key);
-    if (pos == data.map->end()) return false;
-    data.map->erase(pos);
+    UCMapStorage& m = map_storage();
+    if (UniversalMap* tree = tree_of(m)) {
+      if (!tree->erase(key)) return false;
+    }
+    else {
+      UniversalFlatMap::iterator pos = flat_position(m.flat,key);
+      if (pos == m.flat.end() || pos->first != key) return false;
+      m.flat.erase(pos);
+    }
+    if (!m.changed) {
+      UCTrackLock lock;
+      m.changed = true;
+      if (unsigned index = index_of(&m)) count_up(index);
+    }
     return true;
   }
 
@@ -1019,12 +2106,14 @@ namespace JAD {
     if (type != uc_Array) 
       throw internal_ucexception(uce_Non_Array_as_Array);
        
+    UniversalArray& items = array_storage().items;
     UniversalContainer uc;
-    int sz = data.ray->size();
-    data.ray->push_back(uc);
-    dirty = true;
+    uc.in_scope = data.ray->in_arena;
+    items.push_back(uc);
+    stamp_added(items.back());
+    set_dirty();
 	
-    return data.ray->at(sz);
+    return items.back();
   }
 
   //do a logical comparison of two containers. Types must match.
@@ -1044,15 +2133,26 @@ namespace JAD {
     case uc_Character :
       return data.chr == uc.data.chr;
     case uc_String :
-      return *(data.str) == *(uc.data.str);
+      return string_length() == uc.string_length() &&
+	!memcmp(string_chars(),uc.string_chars(),string_length());
     case uc_WString :
-      return *(data.wstr) == *(uc.data.wstr);
+      return data.wstr->value == uc.data.wstr->value;
     case uc_Map :
       if (data.map == uc.data.map) return true;
-      return compare_map(*(data.map),*(uc.data.map));
+      if (tree_of(map_storage()) && tree_of(uc.map_storage()))
+	return compare_map(*tree_of(map_storage()),*tree_of(uc.map_storage()));
+      else {
+	std::vector<UniversalMapEntry> entries = map_entries();
+	if (entries.size() != uc.size()) return false;
+	for (size_t i = 0; i < entries.size(); i++) {
+	  UniversalContainer* other = uc.map_find(*entries[i].first);
+	  if (!other || !(*entries[i].second == *other)) return false;
+	}
+	return true;
+      }
     case uc_Array :
       if (data.ray == uc.data.ray) return true;
-      return compare_vector(*(data.ray),*(uc.data.ray));
+      return compare_vector(array_storage().items,uc.array_storage().items);
     case uc_Null :
       return true;
     }
@@ -1084,7 +2184,7 @@ namespace JAD {
     }
   }
 
-  bool UniversalContainer::operator==(std::string s) const
+  bool UniversalContainer::operator==(const std::string& s) const
   {
     std::string comp;
     try {
@@ -1138,7 +2238,12 @@ namespace JAD {
     if (type != uc_Map)
       throw internal_ucexception(uce_Non_Map_as_Map);
 
-    return ::keys_for_map(*(data.map));
+    std::vector<UniversalMapEntry> entries = sorted_map_entries();
+    std::vector<std::string> keys;
+    keys.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+      keys.push_back(*entries[i].first);
+    return keys;
   }
 
   //sizeof(wchar_t) differs for windows/unix, so we go through some
@@ -1172,54 +2277,203 @@ namespace JAD {
     return wstr;
   }
 
+  /*
+    Dirty tracking. See UCTracking above for how a change deep in a
+    collection is noticed without looking at every element.
+   */
+  UCTracking* UniversalContainer::tracking(void) const
+  {
+    if (type == uc_Map) return &data.map->value;
+    if (type == uc_Array) return &data.ray->value;
+    return NULL;
+  }
+
+  //has home count what this container holds, now it is there. The
+  //lock is held by the caller, as for the rest of these.
+  void UniversalContainer::join_home(unsigned h) const
+  {
+    if (dirty) count_up(h);
+    if (UCTracking* t = tracking()) add_owner(t,h);
+  }
+
+  void UniversalContainer::leave_home(unsigned h) const
+  {
+    if (dirty) count_down(h);
+    if (UCTracking* t = tracking()) drop_owner(t,h);
+  }
+
+  //makes index the home of e
+  void UniversalContainer::stamp(UniversalContainer& e, unsigned index)
+  {
+    if (e.home == index) return;
+    if (e.home) e.leave_home(e.home);
+    e.home = index;
+    e.join_home(index);
+    e.note_external();
+  }
+
+  //stamps every element, after they may have been moved. The
+  //collection has been filled, since it has elements to stamp.
+  void UniversalContainer::stamp_elements(void) const
+  {
+    unsigned index = index_of(tracking());
+    if (!index) return;
+    if (type == uc_Array) {
+      UniversalArray& items = data.ray->value.items;
+      for (size_t i = 0; i < items.size(); i++) stamp(items[i],index);
+    }
+    else if (UniversalMap* tree = tree_of(data.map->value)) {
+      UniversalMap::iterator end = tree->end();
+      for (UniversalMap::iterator i = tree->begin(); i != end; i++)
+	stamp(i->second,index);
+    }
+    else {
+      UniversalFlatMap& flat = data.map->value.flat;
+      for (size_t i = 0; i < flat.size(); i++) stamp(flat[i].second,index);
+    }
+  }
+
+  //stamps an element just added. Arrays and hash maps keep their
+  //elements in a vector, which moves them all when it grows, and the
+  //moved elements have lost their home.
+  void UniversalContainer::stamp_added(UniversalContainer& added) const
+  {
+    UCTrackLock lock;
+    unsigned index = index_of(tracking());
+    if (!index) return;
+    UniversalContainer* first = &added;
+    if (type == uc_Array) first = &data.ray->value.items.front();
+#ifdef UC_HASH_MAP
+    else first = &tree_of(data.map->value)->begin()->second;
+#endif
+    if (first != &added && first->home != index) stamp_elements();
+    else stamp(added,index);
+  }
+
+  //true if clean has anything to do here
+  bool UniversalContainer::needs_clean(void) const
+  {
+    if (dirty) return true;
+    UCTracking* t = tracking();
+    return t && (count_get(t->count) || flag_get(t->pinned_below));
+  }
+
   //logically, setting a container makes it dirty, as does adding an element
   //containers are only cleaned when clean is called explictly.
   //libuc doesn't use this functionality yet, but future versions
   //might if there are classes to work with external key stores
   bool UniversalContainer::is_dirty(void) const
   {
-    UniversalMap::iterator im;
-    UniversalMap::iterator mend;
+    std::vector<UniversalMapEntry> entries;
     UniversalArray::iterator ia;
     UniversalArray::iterator aend;
     
     if (dirty) return true;
-
-    switch(type) {
-    case uc_Map :
-
-	mend = data.map->end();
-	for (im = data.map->begin(); im != mend; im++) 
-	  if (im->second.is_dirty()) return true;
-	return false;
-    case uc_Array :
-	aend = data.ray->end();
-	for (ia = data.ray->begin(); ia != aend; ia++)
-	  if (ia->is_dirty()) return true;
-	return false;
-    default :
-      return false; //since dirty == false, and not a collection
+    UCTracking* t = tracking();
+    if (!t) return false; //since dirty == false, and not a collection
+    if (count_get(t->count) || t->changed) return true;
+    if (!flag_get(t->pinned_below)) return false;
+
+    //something in here may have changed behind the counts
+    if (type == uc_Map) {
+      entries = map_entries();
+      for (size_t i = 0; i < entries.size(); i++)
+	if (entries[i].second->is_dirty()) return true;
+    }
+    else {
+      aend = array_storage().items.end();
+      for (ia = array_storage().items.begin(); ia != aend; ia++)
+	if (ia->is_dirty()) return true;
     }
-    return false; //should not get here.
+    return false;
   }
 
   void UniversalContainer::clean(void)
   {
-    UniversalMap::iterator im;
-    UniversalMap::iterator mend;
+    std::vector<UniversalMapEntry> entries;
     UniversalArray::iterator ia;
     UniversalArray::iterator aend;
     
-    dirty = false;
+    if (dirty) {
+      dirty = false;
+      if (home) {
+	UCTrackLock lock;
+	count_down(home);
+      }
+    }
+    UCTracking* t = tracking();
+    if (t && unfilled(type == uc_Map ? data.map->value.deferred :
+		      data.ray->value.deferred))
+      t->fill_clean = true;
+    if (!needs_clean()) return;
+    if (flag_get(t->pinned)) { //elements may have been added or moved
+      UCTrackLock lock;
+      stamp_elements();
+    }
+
     switch(type) {
     case uc_Map :
-      mend = data.map->end();
-      for (im = data.map->begin(); im != mend; im++) 
-	im->second.clean();
+#ifdef UC_THREADSAFE
+      {
+	//left behind by map_tree, which could not free them
+	UCMapStorage& m = map_storage();
+	if (tree_of(m) && !m.flat.empty())
+	  UniversalFlatMap(m.flat.get_allocator()).swap(m.flat);
+      }
+#endif
+      entries = map_entries();
+      for (size_t i = 0; i < entries.size(); i++)
+	if (entries[i].second->needs_clean()) entries[i].second->clean();
+      break;
     case uc_Array :
-      aend = data.ray->end();
-      for (ia = data.ray->begin(); ia != aend; ia++)
-	ia->clean(); 
+      aend = array_storage().items.end();
+      for (ia = array_storage().items.begin(); ia != aend; ia++)
+	if (ia->needs_clean()) ia->clean();
+      break;
+    }
+    if (t->changed) {
+      UCTrackLock lock;
+      t->changed = false;
+      if (t->index) count_down(t->index);
+    }
+  }
+
+  //the dotted paths of everything changed since the last clean. a
+  //collection that is dirty itself, or has lost keys, is listed
+  //rather than its contents, and "" stands for this container.
+  std::vector<std::string> UniversalContainer::dirty_paths(void) const
+  {
+    std::vector<std::string> paths;
+    collect_dirty_paths("",paths);
+    return paths;
+  }
+
+  void UniversalContainer::collect_dirty_paths(const string& path,
+					       std::vector<std::string>& paths) const
+  {
+    UCTracking* t = tracking();
+    if (dirty || (t && t->changed)) {
+      paths.push_back(path);
+      return;
+    }
+    if (!needs_clean()) return;
+
+    string prefix = path.empty() ? path : path + ".";
+    if (type == uc_Map) {
+      std::vector<UniversalMapEntry> entries = sorted_map_entries();
+      for (size_t i = 0; i < entries.size(); i++) {
+	if (entries[i].second->needs_clean())
+	  entries[i].second->collect_dirty_paths(prefix + *entries[i].first,paths);
+      }
+    }
+    else {
+      char buf[32];
+      UniversalArray& items = array_storage().items;
+      for (size_t i = 0; i < items.size(); i++) {
+	if (!items[i].needs_clean()) continue;
+	snprintf(buf,32,"%lu",(unsigned long)i);
+	items[i].collect_dirty_paths(prefix + buf,paths);
+      }
     }
   }
 
@@ -13,6 +13,27 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <utility>
+
+//the build options chosen by configure
+#include "ucconfig.h"
+
+//move constructors and rvalue setters need a C++11 compiler
+#if __cplusplus >= 201103L
+#define UC_MOVE_SEMANTICS
+#endif
+
+#ifdef UC_HASH_MAP
+#include "ucmap.h"
+#endif
+
+//collections use the arena aware allocator when built with UC_ARENA
+#ifdef UC_ARENA
+#include "ucarena.h"
+#define UC_ALLOCATOR UCAllocator
+#else
+#define UC_ALLOCATOR std::allocator
+#endif
 
 /*
  * Used internally by UniversalContainer. Almost always you will
@@ -32,47 +53,127 @@ namespace JAD {
   const char uc_Array      =11;
   const char uc_Unknown    =-1;
 
+  //strings of up to this many characters are stored directly in the
+  //container, rather than in a shared heap allocation.
+  const size_t uc_Inline_Length = 10;
+
+  //when built with UC_FLAT_MAP, maps with up to this many keys are
+  //kept in a flat vector, sorted by key, rather than in a UniversalMap.
+#ifdef UC_FLAT_MAP
+  const size_t uc_Flat_Map_Limit = 8;
+#else
+  const size_t uc_Flat_Map_Limit = 0;
+#endif
+
   
   typedef char UniversalContainerType;
   class UniversalContainer;
+  class UCPath;
+  class JSONIndexDecoder;
+  class JSONEncoder;
   
-  typedef std::vector<UniversalContainer> UniversalArray;
-  typedef std::map<std::string,UniversalContainer> UniversalMap;
+  typedef std::vector<UniversalContainer,
+		      UC_ALLOCATOR<UniversalContainer> > UniversalArray;
+#ifdef UC_HASH_MAP
+  typedef UCHashMap<UniversalContainer,UC_ALLOCATOR> UniversalMap;
+#else
+  typedef std::map<std::string,UniversalContainer,std::less<std::string>,
+		   UC_ALLOCATOR<std::pair<const std::string,UniversalContainer> > > UniversalMap;
+#endif
+
+  //a key and value in a map, as handed out by sorted_map_entries
+  typedef std::pair<const std::string*,UniversalContainer*> UniversalMapEntry;
+  struct UCMapStorage;
+  struct UCArrayStorage;
+  struct UCTracking;
+  class UCArena;
+
+  //Heap storage for strings, maps and arrays. The count of containers
+  //sharing the value lives in the same allocation.
+  template <typename T>
+  struct UCShared {
+    unsigned refcount;
+    bool in_arena; //set for blocks carved out of a UCArena
+    T value;
+
+    UCShared(void) : refcount(1), in_arena(false) {}
+    UCShared(const T& v) : refcount(1), in_arena(false), value(v) {}
+#ifdef UC_MOVE_SEMANTICS
+    UCShared(T&& v) : refcount(1), in_arena(false), value(std::move(v)) {}
+#endif
+  };
+
+  //makes the elements of a map or array the first time anything looks
+  //at them, as for uc_decode_json_lazy. fill is handed the empty
+  //collection, and is run at most once.
+  struct UCDeferred {
+    virtual ~UCDeferred(void) {}
+    virtual void fill(UniversalContainer&) = 0;
+  };
 
   //todo
   //set reference
-  //size reduction
-  //dirty flag
   class UniversalContainer
   {
+    friend class UCPath;
+    friend class JSONIndexDecoder;
+    friend class BinaryDecoder;
+    friend class BinaryEncoder;
+    friend class JSONEncoder;
+
   protected :
     
     //member variables
-    UniversalContainerType type;
-    bool dirty;
-    unsigned* refcount;
-    
+    //a container is 16 bytes. The type and flags sit in the last bytes,
+    //and a short string overlays everything before them. (Anonymous
+    //structs are a GNU extension, supported by gcc and clang.)
     union {
-      double real;
-      bool tf;
-      char chr;
-      long num;
-      std::string* str;
-      std::wstring* wstr;
-      UniversalArray* ray;
-      UniversalMap* map;
-      void* reference;
-    } data;
+      char bytes[16]; //the whole container, for copying
+      char chars[uc_Inline_Length + 1]; //a short string, nul terminated
+      struct {
+	union {
+	  double real;
+	  bool tf;
+	  char chr;
+	  long num;
+	  UCShared<std::string>* str;
+	  UCShared<std::wstring>* wstr;
+	  UCShared<UCArrayStorage>* ray;
+	  UCShared<UCMapStorage>* map;
+	  void* reference;
+	  const char* span; //a long string held in an arena or a borrowed buffer
+	} data;
+	unsigned short span_length;
+	//the space left in chars by a short string, so 0, doubling as
+	//the nul, when chars is full. Also marks long strings.
+	unsigned char inline_room;
+	UniversalContainerType type;
+	unsigned home : 30; //the collection holding this, see UCTracking
+	unsigned in_scope : 1; //made in an arena scope, see value_arena
+	unsigned dirty : 1;
+      };
+    };
     
     //internal setter methods
     //used by constructors and assignment operators
+    inline void init_flags(void);
     inline void set_value_integer(long);
     inline void set_value_char(char);
     inline void set_value_double(double);
     inline void set_value_bool(bool);
     inline void set_value_string(const std::string&);
+#ifdef UC_MOVE_SEMANTICS
+    inline void set_value_string(std::string&&);
+#endif
     inline void set_value_wstring(const std::wstring&);
     inline void set_value_cstr(const char*);
+    void spill_string(void);
+    UCArena* value_arena(void) const;
+    inline void note_external(void) const;
+    
+    //access to string contents, whether inline or on the heap
+    inline const char* string_chars(void) const;
+    inline size_t string_length(void) const;
     
     //internal conversion methods
     //used by casting and equality testing operators
@@ -88,14 +189,40 @@ namespace JAD {
     //exposed through multiple interfaces, which are
     //more user friendly
     void duplicate(const UniversalContainer&);
-    inline UniversalContainer& map_brackets(std::string);
+    inline bool shared(void) const;
+    void retain(void);
+    void release(void);
+    void swap_contents(UniversalContainer&);
+    inline UniversalContainer& map_brackets(const std::string&);
+    UniversalContainer& path_step(const std::string&, bool, int);
+    UniversalContainer* find_step(const std::string&, bool, int) const;
+    static bool parse_index(const std::string&, int&);
+    UniversalMap* map_tree(void) const;
+    UniversalContainer* map_find(const std::string&) const;
+    UniversalContainer& map_element(const std::string&);
+    std::vector<UniversalMapEntry> map_entries(void) const;
+    UniversalArray& array_items(void) const;
+    inline UCMapStorage& map_storage(void) const;
+    inline UCArrayStorage& array_storage(void) const;
+    void fill_deferred(UCDeferred*&) const;
+    void init_deferred(UniversalContainerType, UCDeferred*);
+    UCTracking* tracking(void) const;
+    inline void set_dirty(void);
+    void join_home(unsigned) const;
+    void leave_home(unsigned) const;
+    static void stamp(UniversalContainer&, unsigned);
+    void stamp_elements(void) const;
+    void stamp_added(UniversalContainer&) const;
+    bool needs_clean(void) const;
+    void collect_dirty_paths(const std::string&,
+			     std::vector<std::string>&) const;
     
     //utility functions
     static std::string convert_wstring_to_string(const std::wstring* w);
     static std::wstring convert_string_to_wstring(const std::string* s);
-    static double convert_string_to_double(const std::string* s);
+    static double convert_string_to_double(const char* s, size_t len);
     static double convert_wstring_to_double(const std::wstring* s);
-    static long convert_string_to_long(const std::string* s);
+    static long convert_string_to_long(const char* s);
     static long convert_wstring_to_long(const std::wstring* s);
    
   public: 
@@ -106,11 +233,16 @@ namespace JAD {
     UniversalContainer(double);
     UniversalContainer(bool);
     UniversalContainer(char);
-    UniversalContainer(const std::string);
-    UniversalContainer(const std::wstring);
+    UniversalContainer(const std::string&);
+    UniversalContainer(const std::wstring&);
     UniversalContainer(char*);
     UniversalContainer(const UniversalContainer&);
+#ifdef UC_MOVE_SEMANTICS
+    UniversalContainer(std::string&&);
+    UniversalContainer(UniversalContainer&&) noexcept;
+#endif
     void string_interpret(const std::string s);
+    void borrow_string(const char* s, size_t len);
     
     //destructor
     ~UniversalContainer(void);
@@ -129,10 +261,11 @@ namespace JAD {
     
     //container access
     UniversalContainer& operator[](int);
-    UniversalContainer& operator[](std::string);
-    UniversalContainer& operator[](std::wstring);
+    UniversalContainer& operator[](const std::string&);
+    UniversalContainer& operator[](const std::wstring&);
     UniversalContainer& operator[](char*);
     UniversalContainer& operator[](const char*);
+    UniversalContainer& operator[](const UCPath&);
     
     //assignment operators
     UniversalContainer& operator=(long);
@@ -144,6 +277,10 @@ namespace JAD {
     UniversalContainer& operator=(const std::wstring&);
     UniversalContainer& operator=(const char*);
     UniversalContainer& operator=(const UniversalContainer&);
+#ifdef UC_MOVE_SEMANTICS
+    UniversalContainer& operator=(std::string&&);
+    UniversalContainer& operator=(UniversalContainer&&) noexcept;
+#endif
     
     //logical operators
     bool operator==(const UniversalContainer&) const;
@@ -151,20 +288,21 @@ namespace JAD {
     bool operator==(long) const;
     bool operator==(char) const;
     bool operator==(double) const;
-    bool operator==(std::string) const;
-    bool operator==(std::wstring) const;
+    bool operator==(const std::string&) const;
+    bool operator==(const std::wstring&) const;
     bool operator==(bool) const;
     
     //support operations
     UniversalContainerType get_type(void) const;
     UniversalContainer clone(void) const;
-    bool remove(const std::string key);
+    bool remove(const std::string& key);
     void clear(void);
-    bool exists(const std::string key) const;
+    bool exists(const std::string& key) const;
     size_t size(void) const;
     size_t length(void) const;
     bool is_dirty(void) const;
     void clean(void);
+    std::vector<std::string> dirty_paths(void) const;
     UniversalContainer& added_element(void);
     std::vector<std::string> keys_for_map(void) const;
     
@@ -179,6 +317,7 @@ namespace JAD {
     UniversalArray::iterator vector_end(void) const;
     UniversalMap* get_map(void) const;
     UniversalArray* get_vector(void) const;
+    std::vector<UniversalMapEntry> sorted_map_entries(void) const;
     
     static UniversalContainer construct_exception(const int, const char* = NULL,
 						  const char* = NULL,
@@ -0,0 +1,210 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+#include <cstdio>
+#include <limits>
+#include "ucontainer.h"
+#include "ucpath.h"
+
+using namespace std;
+
+namespace JAD {
+
+  UCPath::UCPath(const string& p) : path(p)
+  {
+    parse();
+  }
+
+  UCPath::UCPath(const char* p) : path(p ? p : "")
+  {
+    parse();
+  }
+
+  //split on dots. as with the brackets operator, a trailing dot
+  //names nothing, but empty segments elsewhere are empty keys.
+  void UCPath::parse(void)
+  {
+    size_t start = 0;
+    for (;;) {
+      size_t pos = path.find('.',start);
+      Segment seg;
+      seg.key = path.substr(start,pos == string::npos ? string::npos : pos - start);
+      seg.index = 0;
+      seg.numeric = UniversalContainer::parse_index(seg.key,seg.index);
+      segments.push_back(seg);
+      if (pos == string::npos) break;
+      start = pos + 1;
+      if (start == path.length()) break;
+    }
+  }
+
+  UniversalContainer& UCPath::get(UniversalContainer& uc) const
+  {
+    UniversalContainer* node = &uc;
+    for (size_t i = 0; i < segments.size(); i++)
+      node = &node->path_step(segments[i].key,segments[i].numeric,
+			      segments[i].index);
+    return *node;
+  }
+
+  UniversalContainer* UCPath::find(const UniversalContainer& uc) const
+  {
+    const UniversalContainer* node = &uc;
+    for (size_t i = 0; node && i < segments.size(); i++)
+      node = node->find_step(segments[i].key,segments[i].numeric,
+			     segments[i].index);
+    return const_cast<UniversalContainer*>(node);
+  }
+
+  bool UCPath::exists(const UniversalContainer& uc) const
+  {
+    return find(uc) != NULL;
+  }
+
+  size_t UCPath::length(void) const
+  {
+    return segments.size();
+  }
+
+  const string& UCPath::to_string(void) const
+  {
+    return path;
+  }
+
+  UCPathSet::UCPathSet(void)
+  {
+    new_node();
+  }
+
+  UCPathSet::UCPathSet(const vector<string>& paths)
+  {
+    new_node();
+    for (size_t i = 0; i < paths.size(); i++) add(paths[i]);
+  }
+
+  void UCPathSet::add(const string& path)
+  {
+    add(UCPath(path));
+  }
+
+  void UCPathSet::add(const UCPath& path)
+  {
+    insert(0,path,0);
+  }
+
+  bool UCPathSet::empty(void) const
+  {
+    return !nodes[0].whole && !nodes[0].any && nodes[0].keys.empty();
+  }
+
+  size_t UCPathSet::new_node(void)
+  {
+    Node n;
+    n.whole = false;
+    n.any = 0;
+    n.last_index = -1;
+    nodes.push_back(n);
+    return nodes.size() - 1;
+  }
+
+  //a named branch always holds everything its "*" sibling does, so
+  //a lookup needs only follow one of them
+  void UCPathSet::insert(size_t node, const UCPath& path, size_t i)
+  {
+    if (i == path.segments.size()) {
+      nodes[node].whole = true;
+      return;
+    }
+    const UCPath::Segment& seg = path.segments[i];
+    if (seg.key == "*") {
+      if (!nodes[node].any) {
+	size_t any = new_node();
+	nodes[node].any = any;
+      }
+      insert(nodes[node].any,path,i + 1);
+      map<string,size_t>::iterator k;
+      for (k = nodes[node].keys.begin(); k != nodes[node].keys.end(); k++)
+	insert(k->second,path,i + 1);
+      return;
+    }
+    map<string,size_t>::iterator k = nodes[node].keys.find(seg.key);
+    size_t next;
+    if (k != nodes[node].keys.end()) next = k->second;
+    else {
+      next = new_node();
+      nodes[node].keys[seg.key] = next;
+      if (seg.numeric && seg.index > nodes[node].last_index)
+	nodes[node].last_index = seg.index;
+      if (nodes[node].any) copy(next,nodes[node].any);
+    }
+    insert(next,path,i + 1);
+  }
+
+  //adds the branches below from to the fresh node to
+  void UCPathSet::copy(size_t to, size_t from)
+  {
+    nodes[to].whole = nodes[from].whole;
+    nodes[to].last_index = nodes[from].last_index;
+    if (nodes[from].any) {
+      size_t any = new_node();
+      nodes[to].any = any;
+      copy(any,nodes[from].any);
+    }
+    vector<pair<string,size_t> > keys(nodes[from].keys.begin(),nodes[from].keys.end());
+    for (size_t i = 0; i < keys.size(); i++) {
+      size_t n = new_node();
+      nodes[to].keys[keys[i].first] = n;
+      copy(n,keys[i].second);
+    }
+  }
+
+  size_t UCPathSet::step(size_t node, const string& key) const
+  {
+    if (key.find('.') != string::npos) {
+      UCPath path(key);
+      for (size_t i = 0; i < path.segments.size(); i++) {
+	node = step(node,path.segments[i].key);
+	if (!node || nodes[node].whole) break;
+      }
+      return node;
+    }
+    const Node& n = nodes[node];
+    map<string,size_t>::const_iterator k = n.keys.find(key);
+    return k != n.keys.end() ? k->second : n.any;
+  }
+
+  size_t UCPathSet::step(size_t node, int index) const
+  {
+    const Node& n = nodes[node];
+    if (index <= n.last_index) {
+      char key[16];
+      snprintf(key,sizeof(key),"%d",index);
+      map<string,size_t>::const_iterator k = n.keys.find(key);
+      if (k != n.keys.end()) return k->second;
+    }
+    return n.any;
+  }
+
+  bool UCPathSet::whole(size_t node) const
+  {
+    return nodes[node].whole;
+  }
+
+  long UCPathSet::last_index(size_t node) const
+  {
+    if (nodes[node].any) return numeric_limits<long>::max();
+    return nodes[node].last_index;
+  }
+
+  UniversalContainer& UniversalContainer::operator[](const UCPath& path)
+  {
+    return path.get(*this);
+  }
+
+} //end namespace
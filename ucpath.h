@@ -0,0 +1,103 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+/*
+  A dotted path, such as "dependants.1.name", split up and parsed once
+  so that it can be applied to many containers. Applying a path
+  follows the same rules as the brackets operator: a numeric segment
+  indexes an array, unless the container it is applied to is already
+  a map.
+*/
+
+#ifndef _UCPATH_H_
+#define _UCPATH_H_
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace JAD {
+
+  class UniversalContainer;
+
+  class UCPath {
+    friend class UCPathSet;
+    friend class UCView;
+  public:
+    explicit UCPath(const std::string& path);
+    explicit UCPath(const char* path);
+
+    //the element named by the path, creating missing elements on
+    //the way as the brackets operator does
+    UniversalContainer& get(UniversalContainer& uc) const;
+
+    //the element named by the path, or NULL if it is not there.
+    //nothing is created and no exceptions are thrown.
+    UniversalContainer* find(const UniversalContainer& uc) const;
+    bool exists(const UniversalContainer& uc) const;
+
+    size_t length(void) const;
+    const std::string& to_string(void) const;
+
+  private:
+    struct Segment {
+      std::string key;
+      bool numeric;
+      int index;
+    };
+
+    std::string path;
+    std::vector<Segment> segments;
+
+    void parse(void);
+  };
+
+  /*
+    A set of paths, for decoding only part of a document. A "*"
+    segment stands for every key of a map, or every element of an
+    array. A path names its element and everything below it. The set
+    is kept as a tree of steps, walked from node 0, where a step with
+    both a named and a "*" branch takes the union of the two.
+  */
+  class UCPathSet {
+  public:
+    UCPathSet(void);
+    explicit UCPathSet(const std::vector<std::string>& paths);
+    void add(const std::string& path);
+    void add(const UCPath& path);
+    bool empty(void) const;
+
+    //the node below node for key, or 0 if nothing below it is
+    //wanted. A dotted key is a path of its own, as with the brackets
+    //operator.
+    size_t step(size_t node, const std::string& key) const;
+    size_t step(size_t node, int index) const;
+    //true if everything at and below node is wanted
+    bool whole(size_t node) const;
+    //the last array index step can accept at node, or -1 for none
+    long last_index(size_t node) const;
+
+  private:
+    struct Node {
+      bool whole;
+      size_t any; //the "*" branch, or 0
+      long last_index; //the largest numeric key
+      std::map<std::string,size_t> keys;
+    };
+
+    std::vector<Node> nodes;
+
+    size_t new_node(void);
+    void insert(size_t node, const UCPath& path, size_t i);
+    void copy(size_t to, size_t from);
+  };
+
+} //end namespace
+
+#endif
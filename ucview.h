@@ -0,0 +1,92 @@
+/*
+ * UniversalContainer library.
+ * Copyright Jason Denton, 2008,2010,2012.
+ * Made available under the new BSD license, as described in LICENSE
+ *
+ * Send comments and bug reports to jason.denton@gmail.com
+ * http://www.greatpanic.com/code.html
+ */
+
+/*
+  A read only view of a container in the binary form, looked at where
+  it lies in the buffer. Looking up a key or an index makes nothing and
+  allocates nothing; only converting a string to std::string, or
+  decoding, copies anything. Maps and arrays written with
+  uc_Binary_Offsets are looked up through their offset tables, maps by
+  binary search. With uc_Binary_Keys, a key is found in the key table
+  once, and maps are searched for its index. Without them, elements
+  are found by stepping over the ones before, which uc_Binary_Lengths
+  makes a jump for each map or array. The buffer must outlive the view.
+*/
+
+#ifndef _UCVIEW_H_
+#define _UCVIEW_H_
+
+#include <string>
+#include "ucontainer.h"
+
+namespace JAD {
+
+  struct Buffer;
+  class UCPath;
+
+  class UCView {
+  public:
+    //a view of nothing, as a missing key gives
+    UCView(void);
+    //the blob at the buffer's read position. Throws
+    //uce_Deserialization_Error if it is not binary version 2 or later.
+    explicit UCView(const Buffer*);
+    UCView(const char* data, size_t len);
+
+    //false for a missing key or index. A stored null exists.
+    bool exists(void) const;
+    UniversalContainerType get_type(void) const;
+    //elements of a collection, or characters of a string
+    size_t size(void) const;
+    size_t length(void) const;
+
+    //the element, or a view of nothing. A dotted key is a path, and a
+    //numeric key indexes an array, as with the brackets operator.
+    UCView operator[](int) const;
+    UCView operator[](const std::string&) const;
+    UCView operator[](const char*) const;
+    UCView operator[](const UCPath&) const;
+
+    //the ith entry of a map, or element of an array
+    std::string key(size_t) const;
+    UCView value(size_t) const;
+
+    //scalars convert as a decoded container would
+    operator int(void) const;
+    operator long(void) const;
+    operator double(void) const;
+    operator bool(void) const;
+    operator char(void) const;
+    operator std::string(void) const;
+    operator std::wstring(void) const;
+    //the bytes of a string, which are not nul terminated
+    const char* data(void) const;
+
+    //a copy of everything at and below the view
+    UniversalContainer decode(void) const;
+
+  private:
+    const unsigned char* at; //the type byte, or NULL
+    const unsigned char* end; //end of the blob
+    const unsigned char* keys; //the key table, or NULL
+    int version;
+    int options;
+
+    UCView(const UCView& parent, const unsigned char* p);
+    void open(const char* data, size_t len);
+    UCView lookup(const char* key, size_t len) const;
+    UCView step(const char* key, size_t len) const;
+    UCView find_key(const char* key, size_t len) const;
+    const unsigned char* entry(size_t i) const;
+    UniversalContainer scalar(void) const;
+  };
+
+} //end namespace
+
+#endif